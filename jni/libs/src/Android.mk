@@ -135,6 +135,9 @@ LOCAL_SRC_FILES := \
   src/components/time_limit.cpp \
   src/default_entity_factory.cpp \
   src/default_graph_factory.cpp \
+  src/dynamic_resolution.cpp \
+  src/entity_file_loader.cpp \
+  src/frame_pacer.cpp \
   src/full_screen_fader.cpp \
   src/game.cpp \
   src/gpg_manager.cpp \
@@ -143,7 +146,9 @@ LOCAL_SRC_FILES := \
   src/inputcontrollers/gamepad_controller.cpp \
   src/inputcontrollers/onscreen_controller.cpp \
   src/invites.cpp \
+  src/level_streamer.cpp \
   src/main.cpp \
+  src/mapped_file.cpp \
   src/messaging.cpp \
   src/modules/attributes.cpp \
   src/modules/gpg.cpp \
@@ -153,8 +158,11 @@ LOCAL_SRC_FILES := \
   src/modules/state.cpp \
   src/modules/ui_string.cpp \
   src/modules/zooshi.cpp \
+  src/prototype_cache.cpp \
+  src/rail_visibility.cpp \
   src/railmanager.cpp \
   src/remote_config.cpp \
+  src/render_snapshot.cpp \
   src/states/game_menu_state.cpp \
   src/states/game_over_state.cpp \
   src/states/gameplay_state.cpp \
@@ -13,6 +13,8 @@
 // limitations under the License.
 
 #include "camera.h"
+#include <math.h>
+#include <algorithm>
 
 using mathfu::vec2i;
 using mathfu::vec2;
@@ -66,6 +68,24 @@ mathfu::mat4 Camera::GetViewMatrix(int32_t index) const {
   return mat4::LookAt(position_[index] - facing_, position_[index], up_);
 }
 
+ViewCone::ViewCone(const corgi::CameraInterface& camera)
+    : position_(camera.position()), facing_(camera.facing().Normalized()) {
+  // viewport_angle is the vertical field of view. The corners are further out
+  // than the top and bottom by the aspect ratio.
+  const vec2 resolution = camera.viewport_resolution();
+  const float aspect = resolution.y > 0.0f ? resolution.x / resolution.y : 1.0f;
+  half_angle_ = atanf(tanf(camera.viewport_angle() * 0.5f) *
+                      sqrtf(1.0f + aspect * aspect));
+}
+
+bool ViewCone::ContainsSphere(const vec3& center, float radius) const {
+  const vec3 to_center = center - position_;
+  const float distance = to_center.Length();
+  if (distance <= radius) return true;
+  const float cos_angle = vec3::DotProduct(to_center, facing_) / distance;
+  const float angle = acosf(std::max(-1.0f, std::min(cos_angle, 1.0f)));
+  return angle <= half_angle_ + asinf(radius / distance);
+}
 
 }  // zooshi
 }  // fpl
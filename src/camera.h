@@ -130,6 +130,25 @@ class Camera : public corgi::CameraInterface {
   bool stereo_;
 };
 
+// A cone from the camera's position along its facing, through the corners of
+// its view, so it holds the whole frustum. Bounding spheres are cheaper to
+// test against it than against the frustum's planes.
+class ViewCone {
+ public:
+  explicit ViewCone(const corgi::CameraInterface& camera);
+
+  // Returns true if any part of the sphere is inside the cone.
+  bool ContainsSphere(const mathfu::vec3& center, float radius) const;
+
+  MATHFU_DEFINE_CLASS_SIMD_AWARE_NEW_DELETE
+
+ private:
+  mathfu::vec3 position_;
+  mathfu::vec3 facing_;
+  // Angle between the facing and the cone's surface.
+  float half_angle_;
+};
+
 }  // zooshi
 }  // fpl
 
@@ -494,6 +494,7 @@ void PatronComponent::UpdateAllEntities(corgi::WorldTime delta_time) {
       } else if (anim_ending) {
         // Disable event patron since we've played the last event.
         SetState(kPatronStateLayingDown, patron_data);
+        StopAnimating(patron_data);
       }
     }
 
@@ -560,6 +561,9 @@ void PatronComponent::UpdateAllEntities(corgi::WorldTime delta_time) {
           // the physics, as they are no longer in the world.
           physics_component->DisablePhysics(patron);
           SetState(kPatronStateLayingDown, patron_data);
+          // Laying down patrons are hidden, so there's no reason to keep
+          // evaluating their skeleton. Getting up starts a new animation.
+          StopAnimating(patron_data);
           break;
 
         case kPatronStateGettingUp: {
@@ -624,6 +628,13 @@ void PatronComponent::Animate(PatronData* patron_data, PatronAction action) {
       patron_data->render_child, action);
 }
 
+void PatronComponent::StopAnimating(PatronData* patron_data) {
+  AnimationData* anim = Data<AnimationData>(patron_data->render_child);
+  if (anim->motivator.Valid()) {
+    anim->motivator.Invalidate();
+  }
+}
+
 // Note:  This function is static (because it's a collision handler) so we
 // have to explicitly get a pointer to a component if want to use component
 // methods.
@@ -698,8 +709,9 @@ void PatronComponent::SpawnPointDisplay(const corgi::EntityRef& patron) {
   // Spawn from prototype:
   corgi::EntityRef point_display =
       entity_manager_->GetComponent<ServicesComponent>()
-          ->entity_factory()
-          ->CreateEntityFromPrototype("FloatingPointDisplay", entity_manager_);
+          ->world()
+          ->prototype_cache.CreateEntityFromPrototype("FloatingPointDisplay",
+                                                      entity_manager_);
 
   // Make the point display a child of the patron. We want it to move with
   // the patron.
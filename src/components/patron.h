@@ -320,6 +320,7 @@ class PatronComponent : public corgi::Component<PatronData> {
   float AnimLength(const PatronData* patron_data, PatronAction action) const;
   void SetAnimPlaybackRate(const PatronData* patron_data, float playback_rate);
   void Animate(PatronData* patron_data, PatronAction action);
+  void StopAnimating(PatronData* patron_data);
   motive::Range TargetHeightRange(const corgi::EntityRef& patron) const;
   bool RaftExists() const;
   mathfu::vec3 RaftPosition() const;
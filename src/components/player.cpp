@@ -103,9 +103,9 @@ corgi::EntityRef PlayerComponent::SpawnProjectile(corgi::EntityRef source) {
           ->data());
   corgi::EntityRef projectile =
       entity_manager_->GetComponent<ServicesComponent>()
-          ->entity_factory()
-          ->CreateEntityFromPrototype(current_sushi->prototype()->c_str(),
-                                      entity_manager_);
+          ->world()
+          ->prototype_cache.CreateEntityFromPrototype(
+              current_sushi->prototype()->c_str(), entity_manager_);
   GraphComponent* graph_component =
       entity_manager_->GetComponent<GraphComponent>();
   graph_component->EntityPostLoadFixup(projectile);
@@ -37,7 +37,19 @@
 #include "scene_lab/scene_lab.h"
 #include "scene_lab/corgi/corgi_adapter.h"
 
+// Set to 1, here or with -D, to log how long UpdateAllEntities takes.
+#ifndef ZOOSHI_BENCHMARK_RAIL_DENIZENS
+#define ZOOSHI_BENCHMARK_RAIL_DENIZENS 0
+#endif  // ZOOSHI_BENCHMARK_RAIL_DENIZENS
+
+#if ZOOSHI_BENCHMARK_RAIL_DENIZENS
+#include "SDL_timer.h"
+#endif  // ZOOSHI_BENCHMARK_RAIL_DENIZENS
+
 using mathfu::vec3;
+using mathfu::vec3_packed;
+using mathfu::vec4;
+using mathfu::vec4_packed;
 using corgi::component_library::GraphData;
 
 CORGI_DEFINE_COMPONENT(fpl::zooshi::RailDenizenComponent,
@@ -94,11 +106,105 @@ void RailDenizenData::Initialize(const Rail& r,
   rail = &r;
 }
 
+void RailDenizenData::RebindRail(const Rail& r) {
+  const float rate = PlaybackRate();
+  motivator.SetSplines(
+      r.Splines(), motive::SplinePlayback(
+                       static_cast<float>(motivator.SplineTime()), true, rate));
+  orientation_motivator.SetSplines(
+      r.Splines(),
+      motive::SplinePlayback(
+          static_cast<float>(orientation_motivator.SplineTime()), true, rate));
+  rail = &r;
+}
+
 void RailDenizenData::SetPlaybackRate(float rate, float transition_time) {
   const auto time = static_cast<motive::MotiveTime>(transition_time);
   playback_rate.SetTarget(motive::Target1f(rate, 0.0f, time));
 }
 
+// Cosine and sine of half of an angle in (-pi, pi], from the angle's cosine
+// and whether its sine is negative.
+static inline void HalfAngle(float cosine, bool negative, float* half_cos,
+                             float* half_sin) {
+  *half_cos = sqrtf(std::max(0.0f, (1.0f + cosine) * 0.5f));
+  *half_sin = sqrtf(std::max(0.0f, (1.0f - cosine) * 0.5f));
+  if (negative) *half_sin = -*half_sin;
+}
+
+// Rotating towards the Z axis is a bit complicated, because we want that
+// rotation to happen in local space (so the front of the raft goes up), but
+// rotation on the XY plane should happen in world space. So the orientation
+// is a pitch about -X, by the angle between `direction` and the XY plane,
+// followed by a turn about Z that takes `direction`'s projection onto the
+// plane to +Y. Each is built from the half-angle identities, and the product
+// is written out, which saves the trigonometry, normalization and quaternion
+// products of building them with FromAngleAxis and RotateFromTo.
+static mathfu::quat FaceDirection(const vec3& direction) {
+  const float xy_length_squared =
+      direction.x * direction.x + direction.y * direction.y;
+  const float xy_length = sqrtf(xy_length_squared);
+  const float length =
+      sqrtf(xy_length_squared + direction.z * direction.z);
+  float pitch_cos, pitch_sin, yaw_cos, yaw_sin;
+  HalfAngle(length > 0.0f ? xy_length / length : 1.0f, direction.z < 0.0f,
+            &pitch_cos, &pitch_sin);
+  HalfAngle(xy_length > 0.0f ? direction.y / xy_length : 1.0f,
+            direction.x < 0.0f, &yaw_cos, &yaw_sin);
+  return mathfu::quat(pitch_cos * yaw_cos, -pitch_sin * yaw_cos,
+                      pitch_sin * yaw_sin, pitch_cos * yaw_sin);
+}
+
+#if ZOOSHI_BENCHMARK_RAIL_DENIZENS
+// Log how long `component`'s UpdateAllEntities takes with 10, 100 and 1000
+// more denizens spread along `rail`, on top of the level's own.
+static void BenchmarkUpdateAllEntities(RailDenizenComponent* component,
+                                       corgi::EntityManager* entity_manager,
+                                       const Rail& rail,
+                                       float convergence_rate) {
+  static const int kDenizenCounts[] = {10, 100, 1000};
+  static const int kIterations = 100;
+  static const corgi::WorldTime kDeltaTime = 16;
+  const double ticks_to_ms =
+      1000.0 / static_cast<double>(SDL_GetPerformanceFrequency());
+  motive::MotiveEngine& engine =
+      entity_manager->GetComponent<AnimationComponent>()->engine();
+
+  for (size_t c = 0; c < FPL_ARRAYSIZE(kDenizenCounts); ++c) {
+    const int count = kDenizenCounts[c];
+    std::vector<corgi::EntityRef> entities(count);
+    for (int i = 0; i < count; ++i) {
+      entities[i] = entity_manager->AllocateNewEntity();
+      RailDenizenData* data = component->AddEntity(entities[i]);
+      data->start_time = rail.EndTime() * static_cast<float>(i) / count;
+      data->initial_playback_rate = 1.0f;
+      data->orientation_convergence_rate = convergence_rate;
+      data->update_orientation = true;
+      data->Initialize(rail, engine);
+    }
+
+    const Uint64 start = SDL_GetPerformanceCounter();
+    for (int n = 0; n < kIterations; ++n) {
+      component->UpdateAllEntities(kDeltaTime);
+    }
+    const double update_ms =
+        static_cast<double>(SDL_GetPerformanceCounter() - start) *
+        ticks_to_ms / kIterations;
+    fplbase::LogInfo(
+        "RailDenizenComponent: UpdateAllEntities with %d more denizens "
+        "takes %.4fms",
+        count, update_ms);
+
+    // The entities are only deleted at the end of the frame, so keep them
+    // out of the next count's updates.
+    for (auto iter = entities.begin(); iter != entities.end(); ++iter) {
+      component->GetComponentData(*iter)->enabled = false;
+      entity_manager->DeleteEntity(*iter);
+    }
+  }
+}
+#endif  // ZOOSHI_BENCHMARK_RAIL_DENIZENS
+
 void RailDenizenComponent::Init() {
   ServicesComponent* services =
       entity_manager_->GetComponent<ServicesComponent>();
@@ -123,42 +229,116 @@ void RailDenizenComponent::Init() {
 }
 
 void RailDenizenComponent::UpdateAllEntities(corgi::WorldTime delta_time) {
+  const float delta_seconds =
+      static_cast<float>(delta_time) /
+      static_cast<float>(corgi::kMillisecondsPerSecond);
+  GatherRailBatches();
+  new_lap_entities_.clear();
+  for (auto batch = rail_batches_.begin(); batch != rail_batches_.end();
+       ++batch) {
+    UpdateRailBatch(&*batch, delta_seconds);
+  }
+  for (auto iter = new_lap_entities_.begin(); iter != new_lap_entities_.end();
+       ++iter) {
+    GraphData* graph_data = Data<GraphData>(*iter);
+    if (graph_data) {
+      graph_data->broadcaster.BroadcastEvent(kNewLapEventId);
+    }
+  }
+}
+
+void RailDenizenComponent::GatherRailBatches() {
+  for (auto batch = rail_batches_.begin(); batch != rail_batches_.end();
+       ++batch) {
+    batch->entities.clear();
+    batch->denizens.clear();
+    batch->transforms.clear();
+  }
+  RailBatch* batch = nullptr;
   for (auto iter = component_data_.begin(); iter != component_data_.end();
        ++iter) {
-    RailDenizenData* rail_denizen_data = GetComponentData(iter->entity);
+    RailDenizenData* rail_denizen_data = &iter->data;
     if (!rail_denizen_data->enabled) {
       continue;
     }
+    // Denizens following the same rail are usually loaded together, so the
+    // last batch is checked first.
+    if (batch == nullptr || batch->rail != rail_denizen_data->rail) {
+      batch = nullptr;
+      for (auto b = rail_batches_.begin(); b != rail_batches_.end(); ++b) {
+        if (b->rail == rail_denizen_data->rail) {
+          batch = &*b;
+          break;
+        }
+      }
+      if (batch == nullptr) {
+        rail_batches_.push_back(RailBatch());
+        batch = &rail_batches_.back();
+        batch->rail = rail_denizen_data->rail;
+      }
+    }
+    batch->entities.push_back(iter->entity);
+    batch->denizens.push_back(rail_denizen_data);
+    batch->transforms.push_back(Data<TransformData>(iter->entity));
+  }
+  // Rails that no denizen follows any more may have been deleted.
+  rail_batches_.erase(
+      std::remove_if(rail_batches_.begin(), rail_batches_.end(),
+                     [](const RailBatch& b) { return b.denizens.empty(); }),
+      rail_batches_.end());
+}
+
+void RailDenizenComponent::UpdateRailBatch(RailBatch* batch,
+                                           float delta_seconds) {
+  const size_t count = batch->denizens.size();
+  RailDenizenData* const* denizens = &batch->denizens[0];
+  batch->positions.resize(count);
+  batch->directions.resize(count);
+  batch->orientations.resize(count);
+  vec3_packed* positions = &batch->positions[0];
+  vec3_packed* directions = &batch->directions[0];
+  vec4_packed* orientations = &batch->orientations[0];
+
+  // Read everything the update needs from the motivators.
+  for (size_t i = 0; i < count; ++i) {
+    RailDenizenData* rail_denizen_data = denizens[i];
     rail_denizen_data->SetSplinePlaybackRate(rail_denizen_data->PlaybackRate());
-    TransformData* transform_data = Data<TransformData>(iter->entity);
+    positions[i] = rail_denizen_data->Position();
+    const motive::Motivator3f& motivator =
+        rail_denizen_data->orientation_convergence_rate == 0.0f
+            ? rail_denizen_data->motivator
+            : rail_denizen_data->orientation_motivator;
+    directions[i] = motivator.Direction();
+  }
+
+  // Move the rail's positions into each denizen's frame.
+  for (size_t i = 0; i < count; ++i) {
+    const RailDenizenData* rail_denizen_data = denizens[i];
     vec3 position = rail_denizen_data->rail_orientation.Inverse() *
-                    rail_denizen_data->Position();
+                    vec3(positions[i]);
     position *= rail_denizen_data->rail_scale;
     position += rail_denizen_data->rail_offset;
-    transform_data->position = position;
-    if (rail_denizen_data->update_orientation) {
-      float convergence_rate = rail_denizen_data->orientation_convergence_rate;
-      const motive::Motivator3f& motivator =
-          convergence_rate == 0.0f ? rail_denizen_data->motivator
-                                   : rail_denizen_data->orientation_motivator;
-
-      // Rotating towards the Z axis is a bit complicated, because we want that
-      // rotation to happen in local space (so the front of the raft goes up),
-      // but rotation on the XY plane should happen in world space. So we need
-      // to separate the two rotations from each other to accomplish this.
-      vec3 world_direction = motivator.Direction();
-      const float z_length = world_direction.z;
-      world_direction.z = 0.0f;
-      const float xy_length = world_direction.Length();
-      float z_angle(atan2f(z_length, xy_length));
-      if (z_angle < -M_PI) {
-        z_angle = M_PI;
-      }
+    positions[i] = position;
+  }
+
+  // Face each denizen along the rail.
+  for (size_t i = 0; i < count; ++i) {
+    if (!denizens[i]->update_orientation) continue;
+    const mathfu::quat face = FaceDirection(vec3(directions[i]));
+    orientations[i] = vec4(face.vector(), face.scalar());
+  }
 
-      mathfu::quat target_orientation =
+  for (size_t i = 0; i < count; ++i) {
+    RailDenizenData* rail_denizen_data = denizens[i];
+    TransformData* transform_data = batch->transforms[i];
+    transform_data->position = vec3(positions[i]);
+    if (rail_denizen_data->update_orientation) {
+      const float convergence_rate =
+          rail_denizen_data->orientation_convergence_rate;
+      const vec4 face(orientations[i]);
+      const mathfu::quat target_orientation =
           rail_denizen_data->rail_orientation *
-          mathfu::quat::FromAngleAxis(z_angle, -mathfu::kAxisX3f) *
-          mathfu::quat::RotateFromTo(world_direction, mathfu::kAxisY3f);
+          mathfu::quat(face.w, face.x, face.y, face.z);
       // Convergence is disabled when the playback rate is zero as
       // it's possible for the slerp to yield an invalid quaternion
       // with angles approaching zero.
@@ -166,9 +346,7 @@ void RailDenizenComponent::UpdateAllEntities(corgi::WorldTime delta_time) {
           rail_denizen_data->PlaybackRate() > 0.0f) {
         rail_denizen_data->interpolated_orientation = mathfu::quat::Slerp(
             rail_denizen_data->interpolated_orientation, target_orientation,
-            std::min(convergence_rate * static_cast<float>(delta_time) /
-                         static_cast<float>(corgi::kMillisecondsPerSecond),
-                     1.0f));
+            std::min(convergence_rate * delta_seconds, 1.0f));
         transform_data->orientation =
             rail_denizen_data->interpolated_orientation;
       } else {
@@ -192,10 +370,7 @@ void RailDenizenComponent::UpdateAllEntities(corgi::WorldTime delta_time) {
          rail_denizen_data->lap_progress >= rail_denizen_data->lap_end) ||
         (!use_lap_end && rail_denizen_data->lap_progress < previous_progress)) {
       rail_denizen_data->lap_number++;
-      GraphData* graph_data = Data<GraphData>(iter->entity);
-      if (graph_data) {
-        graph_data->broadcaster.BroadcastEvent(kNewLapEventId);
-      }
+      new_lap_entities_.push_back(batch->entities[i]);
     }
     rail_denizen_data->total_lap_progress =
         rail_denizen_data->lap_progress + rail_denizen_data->lap_number;
@@ -314,10 +489,17 @@ void RailDenizenComponent::UpdateRailNodeData(corgi::EntityRef entity) {
   const RailNodeData* node_data =
       entity_manager_->GetComponentData<RailNodeData>(entity);
   if (node_data != nullptr) {
+    // Rebuilding the rail moves the denizens already on it onto the new
+    // splines. Only denizens that had no rail yet need initializing.
+    entity_manager_->GetComponent<RailNodeComponent>()->NodeChanged(entity);
     const std::string& rail_name = node_data->rail_name;
+    entity_manager_->GetComponent<ServicesComponent>()
+        ->rail_manager()
+        ->GetRailFromComponents(rail_name.c_str(), entity_manager_);
     for (auto iter = begin(); iter != end(); ++iter) {
       const RailDenizenData* rail_denizen_data = GetComponentData(iter->entity);
-      if (rail_denizen_data->rail_name == rail_name) {
+      if (rail_denizen_data->rail_name == rail_name &&
+          rail_denizen_data->rail == nullptr) {
         InitializeRail(iter->entity);
       }
     }
@@ -338,6 +520,24 @@ void RailDenizenComponent::PostLoadFixup() {
           transform_data->scale * rail_data->internal_rail_scale;
     }
   }
+
+#if ZOOSHI_BENCHMARK_RAIL_DENIZENS
+  // Benchmark once, on the first rail that has been loaded. The benchmark
+  // adds denizens, so find the rail before starting it.
+  static bool benchmarked = false;
+  const Rail* benchmark_rail = nullptr;
+  float convergence_rate = 0.0f;
+  for (auto iter = component_data_.begin();
+       benchmark_rail == nullptr && iter != component_data_.end(); ++iter) {
+    benchmark_rail = iter->data.rail;
+    convergence_rate = iter->data.orientation_convergence_rate;
+  }
+  if (!benchmarked && benchmark_rail != nullptr) {
+    benchmarked = true;
+    BenchmarkUpdateAllEntities(this, entity_manager_, *benchmark_rail,
+                               convergence_rate);
+  }
+#endif  // ZOOSHI_BENCHMARK_RAIL_DENIZENS
 }
 
 void RailDenizenComponent::OnEnterEditor() {
@@ -357,19 +557,13 @@ void RailDenizenComponent::OnEnterEditor() {
   }
 }
 
-void RailDenizenComponent::ChangeRail(const Rail* old_rail,
-                                      const Rail* new_rail) {
-  motive::MotiveEngine& motive_engine =
-      entity_manager_->GetComponent<AnimationComponent>()->engine();
-
+void RailDenizenComponent::RebindRail(const Rail* rail) {
   for (auto iter = component_data_.begin(); iter != component_data_.end();
        ++iter) {
-    RailDenizenData* rail_denizen_data = GetComponentData(iter->entity);
-    if (!rail_denizen_data->enabled || rail_denizen_data->rail != old_rail) {
-      continue;
+    RailDenizenData* rail_denizen_data = &iter->data;
+    if (rail_denizen_data->rail == rail) {
+      rail_denizen_data->RebindRail(*rail);
     }
-
-    rail_denizen_data->Initialize(*new_rail, motive_engine);
   }
 }
 
@@ -20,6 +20,7 @@
 #include "breadboard/event.h"
 #include "components_generated.h"
 #include "corgi/component.h"
+#include "corgi_component_library/transform.h"
 #include "mathfu/constants.h"
 #include "mathfu/glsl_mappings.h"
 #include "motive/math/compact_spline.h"
@@ -57,6 +58,10 @@ struct RailDenizenData {
 
   void Initialize(const Rail& rail, motive::MotiveEngine& engine);
 
+  // Follow `rail`'s splines, which have been rebuilt, carrying on from the
+  // same time and playback rate.
+  void RebindRail(const Rail& rail);
+
   // Set speed at which the entity traverses the rail.
   // playback_rate 0 ==> paused
   // playback_rate 0.5 ==> half speed of authored rail (slow)
@@ -128,12 +133,40 @@ class RailDenizenComponent : public corgi::Component<RailDenizenData> {
   // This needs to be called after the entities have been loaded from data.
   void PostLoadFixup();
 
-  // When a Rail is reloaded, we need to reinitialize any data that uses it.
-  void ChangeRail(const Rail* old_rail, const Rail* new_rail);
+  // When a Rail is rebuilt, the denizens following it have to be moved onto
+  // its new splines.
+  void RebindRail(const Rail* rail);
 
  private:
+  // The enabled denizens following one rail. Each update gathers what it
+  // needs from their motivators into parallel arrays, so that a rail's
+  // denizens are moved and oriented together in a few tight loops.
+  struct RailBatch {
+    const Rail* rail;
+    std::vector<corgi::EntityRef> entities;
+    std::vector<RailDenizenData*> denizens;
+    std::vector<corgi::component_library::TransformData*> transforms;
+    std::vector<mathfu::vec3_packed> positions;
+    std::vector<mathfu::vec3_packed> directions;
+    // Orientations are stored as (vector, scalar).
+    std::vector<mathfu::vec4_packed> orientations;
+  };
+
   void InitializeRail(corgi::EntityRef&);
   void OnEnterEditor();
+
+  // Sort the enabled denizens into `rail_batches_` by the rail they follow.
+  void GatherRailBatches();
+
+  // Move and orient the denizens in `batch`, and count their laps. The
+  // entities that start a new lap are added to `new_lap_entities_`.
+  void UpdateRailBatch(RailBatch* batch, float delta_seconds);
+
+  // Kept between updates, so their arrays keep the memory they've allocated.
+  std::vector<RailBatch> rail_batches_;
+  // The new lap events are sent once every denizen has been updated, since
+  // the graphs that handle them may add entities.
+  std::vector<corgi::EntityRef> new_lap_entities_;
 };
 
 }  // zooshi
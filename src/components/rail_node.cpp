@@ -13,6 +13,8 @@
 // limitations under the License.
 
 #include "components/rail_node.h"
+
+#include <algorithm>
 #include "flatbuffers/flatbuffers.h"
 #include "fplbase/utilities.h"
 
@@ -27,7 +29,13 @@ void RailNodeComponent::AddFromRawData(corgi::EntityRef& entity,
   auto rail_node_def = static_cast<const RailNodeDef*>(raw_data);
 
   RailNodeData* data = AddEntity(entity);
-  data->rail_name = rail_node_def->rail_name()->c_str();
+  const std::string rail_name = rail_node_def->rail_name()->c_str();
+  if (data->rail_name != rail_name) {
+    RemoveFromRail(entity, data->rail_name);
+    rails_[rail_name].entities.push_back(entity);
+  }
+  rails_[rail_name].version = next_version_++;
+  data->rail_name = rail_name;
   data->ordering = rail_node_def->ordering();
   if (rail_node_def->total_time())
     data->total_time = rail_node_def->total_time();
@@ -60,5 +68,37 @@ corgi::ComponentInterface::RawDataUniquePtr RailNodeComponent::ExportRawData(
   return fbb.ReleaseBufferPointer();
 }
 
+void RailNodeComponent::CleanupEntity(corgi::EntityRef& entity) {
+  const RailNodeData* data = GetComponentData(entity);
+  if (data != nullptr) RemoveFromRail(entity, data->rail_name);
+}
+
+const RailNodeComponent::RailNodes* RailNodeComponent::GetRailNodes(
+    const std::string& rail_name) const {
+  auto rail = rails_.find(rail_name);
+  return rail != rails_.end() ? &rail->second : nullptr;
+}
+
+void RailNodeComponent::NodeChanged(const corgi::EntityRef& entity) {
+  const RailNodeData* data = GetComponentData(entity);
+  if (data == nullptr) return;
+  auto rail = rails_.find(data->rail_name);
+  if (rail != rails_.end()) rail->second.version = next_version_++;
+}
+
+void RailNodeComponent::RemoveFromRail(const corgi::EntityRef& entity,
+                                       const std::string& rail_name) {
+  auto rail = rails_.find(rail_name);
+  if (rail == rails_.end()) return;
+  std::vector<corgi::EntityRef>& entities = rail->second.entities;
+  entities.erase(std::remove(entities.begin(), entities.end(), entity),
+                 entities.end());
+  if (entities.empty()) {
+    rails_.erase(rail);
+  } else {
+    rail->second.version = next_version_++;
+  }
+}
+
 }  // zooshi
 }  // fpl
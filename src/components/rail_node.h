@@ -16,6 +16,8 @@
 #define FPL_ZOOSHI_COMPONENTS_RAIL_NODE_H_
 
 #include <string>
+#include <unordered_map>
+#include <vector>
 #include "components_generated.h"
 #include "corgi/component.h"
 #include "rail_def_generated.h"
@@ -36,11 +38,37 @@ struct RailNodeData {
 
 class RailNodeComponent : public corgi::Component<RailNodeData> {
  public:
-  RailNodeComponent() {}
+  // The nodes with one rail name, in no particular order, and a version that
+  // changes whenever any of them is added, removed or changed.
+  struct RailNodes {
+    RailNodes() : version(0) {}
+    std::vector<corgi::EntityRef> entities;
+    unsigned int version;
+  };
+
+  RailNodeComponent() : next_version_(1) {}
   virtual ~RailNodeComponent() {}
 
   virtual void AddFromRawData(corgi::EntityRef& entity, const void* data);
   virtual RawDataUniquePtr ExportRawData(const corgi::EntityRef& entity) const;
+  virtual void CleanupEntity(corgi::EntityRef& entity);
+
+  // Returns the nodes of the rail called `rail_name`, or nullptr if there
+  // are none.
+  const RailNodes* GetRailNodes(const std::string& rail_name) const;
+
+  // Call when a node has been moved or edited, so the rail it belongs to is
+  // rebuilt the next time it's asked for.
+  void NodeChanged(const corgi::EntityRef& entity);
+
+ private:
+  void RemoveFromRail(const corgi::EntityRef& entity,
+                      const std::string& rail_name);
+
+  std::unordered_map<std::string, RailNodes> rails_;
+  // Versions are never reused, even by a rail that is removed and added
+  // again.
+  unsigned int next_version_;
 };
 
 }  // zooshi
@@ -67,16 +67,11 @@ const mat4 Render3dTextComponent::CalculateAnimationTransform(
   return mat4::Identity();
 }
 
-const mat4 Render3dTextComponent::CalculateModelViewProjection(
-    const EntityRef& entity, const corgi::CameraInterface& camera) const {
+const mat4 Render3dTextComponent::CalculateModelTransform(
+    const EntityRef& entity) const {
   const TransformData* transform_data = Data<TransformData>(entity);
   const Render3dTextData* render_3d_text_data = Data<Render3dTextData>(entity);
 
-  const vec2i window_size =
-      services_->asset_manager()->renderer().window_size();
-  const float aspect_ratio =
-      static_cast<float>(window_size.x) / static_cast<float>(window_size.y);
-
   // Calculate the animation transform.
   const mat4 anim_transform =
       CalculateAnimationTransform(entity, render_3d_text_data->animation_bone);
@@ -85,11 +80,6 @@ const mat4 Render3dTextComponent::CalculateModelViewProjection(
   // transform.
   const mat4 world_transform = transform_data->world_transform * anim_transform;
 
-  // Center the FlatUI canvas at 0,0 (camera origin).
-  const mat4 center_at_origin = mat4::FromTranslationVector(
-      vec3(render_3d_text_data->canvas_size * aspect_ratio / -2.0f,
-           render_3d_text_data->canvas_size / -2.0f, 0.0f));
-
   // Move the text from the camera origin (0,0) to its location in world space.
   const mat4 translation =
       mat4::FromTranslationVector(vec3(render_3d_text_data->translation));
@@ -105,10 +95,30 @@ const mat4 Render3dTextComponent::CalculateModelViewProjection(
   // Scale the FlatUI down to the correct size for the entity.
   const mat4 scale = mat4::FromScaleVector(vec3(render_3d_text_data->scale));
 
+  // Model * Translation * Rotation * Scale.
+  return world_transform * translation * orientation * scale;
+}
+
+const mat4 Render3dTextComponent::CalculateCenterAtOrigin(
+    int canvas_size) const {
+  const vec2i window_size =
+      services_->asset_manager()->renderer().window_size();
+  const float aspect_ratio =
+      static_cast<float>(window_size.x) / static_cast<float>(window_size.y);
+
+  // Center the FlatUI canvas at 0,0 (camera origin).
+  return mat4::FromTranslationVector(vec3(canvas_size * aspect_ratio / -2.0f,
+                                          canvas_size / -2.0f, 0.0f));
+}
+
+const mat4 Render3dTextComponent::CalculateModelViewProjection(
+    const EntityRef& entity, const corgi::CameraInterface& camera) const {
+  const Render3dTextData* render_3d_text_data = Data<Render3dTextData>(entity);
+
   // Calculate MVP -> Perspective * View * Model * Translation * Rotation *
   //                  Scale * Center At Origin.
-  return camera.GetTransformMatrix() * world_transform * translation *
-         orientation * scale * center_at_origin;
+  return camera.GetTransformMatrix() * CalculateModelTransform(entity) *
+         CalculateCenterAtOrigin(render_3d_text_data->canvas_size);
 }
 
 void Render3dTextComponent::Init() {
@@ -119,41 +129,26 @@ void Render3dTextComponent::InitEntity(EntityRef& entity) {
   entity_manager_->AddEntityToComponent<RenderMeshComponent>(entity);
 }
 
+void Render3dTextComponent::Capture(const EntityRef& entity,
+                                    Render3dTextSnapshot* snapshot) const {
+  const Render3dTextData* render_3d_text_data = Data<Render3dTextData>(entity);
+  snapshot->model_transform =
+      mat4::ToAffineTransform(CalculateModelTransform(entity));
+  snapshot->canvas_size = render_3d_text_data->canvas_size;
+  snapshot->font = render_3d_text_data->font;
+  snapshot->label_size = render_3d_text_data->label_size;
+  snapshot->text = render_3d_text_data->text;
+}
+
 void Render3dTextComponent::Render(const EntityRef& entity,
                                    const corgi::CameraInterface& camera) {
   SetModelViewProjectionMatrix(entity, camera);
 
   const RenderMeshData* rendermesh_data = Data<RenderMeshData>(entity);
-  const Render3dTextData* render_3d_text_data = Data<Render3dTextData>(entity);
-
   if (rendermesh_data && rendermesh_data->visible) {
-    // Create FlatUI in 3D space.
-    flatui::Run(*services_->asset_manager(), *services_->font_manager(),
-                *services_->input_system(), [&]() {
-                  const vec2i window_size =
-                      services_->asset_manager()->renderer().window_size();
-                  const float aspect_ratio =
-                      static_cast<float>(window_size.x) /
-                      static_cast<float>(window_size.y);
-
-                  flatui::SetDepthTest(true);
-                  flatui::UseExistingProjection(
-                      vec2i(static_cast<int>(render_3d_text_data->canvas_size *
-                                             aspect_ratio),
-                            render_3d_text_data->canvas_size));
-                  flatui::StartGroup(flatui::kLayoutOverlay);
-                  {
-                    flatui::PositionGroup(flatui::kAlignCenter,
-                                          flatui::kAlignCenter,
-                                          mathfu::kZeros2f);
-                    {
-                      flatui::SetTextFont(render_3d_text_data->font.c_str());
-                      flatui::Label(render_3d_text_data->text.c_str(),
-                                    render_3d_text_data->label_size);
-                    }
-                  }
-                  flatui::EndGroup();
-                });
+    Render3dTextSnapshot snapshot;
+    Capture(entity, &snapshot);
+    RenderText(snapshot, camera);
   }
 }
 
@@ -165,6 +160,59 @@ void Render3dTextComponent::RenderAllEntities(
   }
 }
 
+void Render3dTextComponent::CaptureAllEntities(
+    std::vector<Render3dTextSnapshot>* snapshots) const {
+  // Overwrite the existing snapshots where there are some, so their strings
+  // can keep the memory they already have.
+  size_t num_snapshots = 0;
+  for (auto iter = component_data_.begin(); iter != component_data_.end();
+       ++iter) {
+    const RenderMeshData* rendermesh_data = Data<RenderMeshData>(iter->entity);
+    if (!rendermesh_data || !rendermesh_data->visible) continue;
+    if (num_snapshots == snapshots->size()) {
+      snapshots->resize(num_snapshots + 1);
+    }
+    Capture(iter->entity, &(*snapshots)[num_snapshots]);
+    ++num_snapshots;
+  }
+  snapshots->resize(num_snapshots);
+}
+
+void Render3dTextComponent::RenderText(
+    const Render3dTextSnapshot& snapshot,
+    const corgi::CameraInterface& camera) {
+  services_->asset_manager()->renderer().set_model_view_projection(
+      camera.GetTransformMatrix() *
+      mat4::FromAffineTransform(snapshot.model_transform) *
+      CalculateCenterAtOrigin(snapshot.canvas_size));
+
+  // Create FlatUI in 3D space.
+  flatui::Run(*services_->asset_manager(), *services_->font_manager(),
+              *services_->input_system(), [&]() {
+                const vec2i window_size =
+                    services_->asset_manager()->renderer().window_size();
+                const float aspect_ratio =
+                    static_cast<float>(window_size.x) /
+                    static_cast<float>(window_size.y);
+
+                flatui::SetDepthTest(true);
+                flatui::UseExistingProjection(vec2i(
+                    static_cast<int>(snapshot.canvas_size * aspect_ratio),
+                    snapshot.canvas_size));
+                flatui::StartGroup(flatui::kLayoutOverlay);
+                {
+                  flatui::PositionGroup(flatui::kAlignCenter,
+                                        flatui::kAlignCenter,
+                                        mathfu::kZeros2f);
+                  {
+                    flatui::SetTextFont(snapshot.font.c_str());
+                    flatui::Label(snapshot.text.c_str(), snapshot.label_size);
+                  }
+                }
+                flatui::EndGroup();
+              });
+}
+
 void Render3dTextComponent::SetModelViewProjectionMatrix(
     const EntityRef& entity, const corgi::CameraInterface& camera) {
   const mat4 mvp = CalculateModelViewProjection(entity, camera);
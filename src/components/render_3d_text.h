@@ -66,6 +66,26 @@ struct Render3dTextData {
   std::string text;
 };
 
+/// @brief The text on an entity, as it was when it was captured. It can be
+/// rendered later without reading the entity again.
+struct Render3dTextSnapshot {
+  /// @brief Transform from the FlatUI canvas, once it has been centered, into
+  /// world space.
+  mathfu::AffineTransform model_transform;
+
+  /// @brief The base size of the FlatUI canvas, as in Render3dTextData.
+  int canvas_size;
+
+  /// @brief The relative path to the font file used for the text.
+  std::string font;
+
+  /// @brief The vertical size (y-size) of the text, in virtual resolution.
+  float label_size;
+
+  /// @brief The text string to be rendered.
+  std::string text;
+};
+
 /// @brief A Component that handles the rendering of text on an entity
 /// in 3D space.
 class Render3dTextComponent : public corgi::Component<Render3dTextData> {
@@ -95,6 +115,15 @@ class Render3dTextComponent : public corgi::Component<Render3dTextData> {
   const mathfu::mat4 CalculateAnimationTransform(
       const corgi::EntityRef& entity, const int animation_bone) const;
 
+  /// @brief Calculate the transform that places the text in world space,
+  /// before the FlatUI canvas is centered.
+  ///
+  /// @param[in] entity A `corgi::EntityRef` reference to the entity that
+  /// should have the text rendered on it.
+  /// @return Returns a `mathfu::mat4` containing the model transform.
+  const mathfu::mat4 CalculateModelTransform(
+      const corgi::EntityRef& entity) const;
+
   /// @brief Calculate the ModelViewProjection (MVP) for the renderer to
   /// correctly project the text into 3D space.
   ///
@@ -148,6 +177,21 @@ class Render3dTextComponent : public corgi::Component<Render3dTextData> {
   /// that should be used when rendering the text within the field of view.
   void RenderAllEntities(const corgi::CameraInterface& camera);
 
+  /// @brief Capture the text on every visible entity that is registered with
+  /// the Render3dTextComponent, so that it can be rendered later.
+  ///
+  /// @param[out] snapshots A `std::vector` that the captured text replaces
+  /// the contents of.
+  void CaptureAllEntities(std::vector<Render3dTextSnapshot>* snapshots) const;
+
+  /// @brief Renders text captured by `CaptureAllEntities()`.
+  ///
+  /// @param[in] snapshot The captured text to render.
+  /// @param[in] camera A `corgi::CameraInterface` reference to the camera
+  /// that should be used when rendering the text within the field of view.
+  void RenderText(const Render3dTextSnapshot& snapshot,
+                  const corgi::CameraInterface& camera);
+
   /// @brief Set the ModelViewProjection (MVP) for the renderer to correctly
   /// project the text into 3D space.
   ///
@@ -170,6 +214,13 @@ class Render3dTextComponent : public corgi::Component<Render3dTextData> {
   void SetText(const char* text, const int text_length);
 
  private:
+  // Capture the text on `entity` into `snapshot`.
+  void Capture(const corgi::EntityRef& entity,
+               Render3dTextSnapshot* snapshot) const;
+
+  // Moves the FlatUI canvas so that its center is at the origin.
+  const mathfu::mat4 CalculateCenterAtOrigin(int canvas_size) const;
+
   ServicesComponent* services_;
 };
 
@@ -14,7 +14,14 @@
 
 #include "components/river.h"
 #include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
 #include <memory>
+#include "SDL_mutex.h"
+#include "SDL_thread.h"
+#include "SDL_timer.h"
+#include "camera.h"
 #include "common.h"
 #include "components/rail_denizen.h"
 #include "components/rail_node.h"
@@ -26,6 +33,8 @@
 #include "corgi_component_library/transform.h"
 #include "fplbase/debug_markers.h"
 #include "fplbase/utilities.h"
+#include "mapped_file.h"
+#include "scene_lab/corgi/corgi_adapter.h"
 #include "scene_lab/scene_lab.h"
 #include "world.h"
 
@@ -48,9 +57,19 @@ namespace zooshi {
 using corgi::component_library::PhysicsComponent;
 using corgi::component_library::RenderMeshComponent;
 using corgi::component_library::RenderMeshData;
+using corgi::component_library::TransformComponent;
+using corgi::component_library::TransformData;
 using scene_lab::SceneLab;
 
-static const size_t kNumIndicesPerQuad = 6;
+// Set to 1, here or with -D, to log how long the bank normals take to
+// compute, compared to computing them from the triangles with
+// Mesh::ComputeNormalsTangents.
+#ifndef ZOOSHI_BENCHMARK_RIVER_NORMALS
+#define ZOOSHI_BENCHMARK_RIVER_NORMALS 0
+#endif  // ZOOSHI_BENCHMARK_RIVER_NORMALS
+
+// Most vertices a single chunk can have, so it can use 16-bit indices.
+static const size_t kMaxChunkVertices = 65536;
 
 // A vertex definition specific to normalmapping with colors.
 struct NormalMappedColorVertex {
@@ -61,13 +80,217 @@ struct NormalMappedColorVertex {
   unsigned char color[4];
 };
 
+// Everything needed to generate a river, gathered on the update thread so
+// that generating it doesn't touch anything shared with other threads.
+struct RiverBuildInput {
+  RiverBuildInput()
+      : river(nullptr),
+        wraps(false),
+        chunk_segments(1),
+        river_material(nullptr),
+        random_seed(0),
+        hash(0) {}
+  const RiverConfig* river;
+  // Positions sampled along the river's rail.
+  std::vector<vec3_packed> track;
+  bool wraps;
+  // Number of segments in each chunk.
+  size_t chunk_segments;
+  // Whether each track position has moved since the last build, and where
+  // that build left every bank vertex. Both are empty when the whole river
+  // has to be generated.
+  std::vector<bool> moved_track;
+  std::vector<vec3_packed> built_bank_positions;
+  // Whether each zone's material has a single texture.
+  std::vector<bool> single_texture_zones;
+  // The materials to upload the water and each zone's banks with.
+  Material* river_material;
+  std::vector<Material*> bank_materials;
+  unsigned int random_seed;
+  // Identifies everything above that affects the generated geometry.
+  uint64_t hash;
+  // Where to load the whole river from, or save it to once it's generated.
+  // Empty when only some of the chunks are being regenerated.
+  std::string cache_filename;
+};
+
+// The generated geometry of one chunk. Positions are relative to `center`.
+struct RiverChunkGeometry {
+  RiverChunkGeometry() : radius(0.0f) {}
+  vec3 center;
+  float radius;
+  std::vector<NormalMappedVertex> river_verts;
+  std::vector<unsigned short> river_indices;
+  std::vector<NormalMappedColorVertex> bank_verts;
+  std::vector<std::vector<unsigned short>> bank_indices_by_zone;
+  // The bank triangles to collide with, three positions per triangle.
+  // Unlike the vertices, these are relative to the river.
+  std::vector<vec3_packed> collision_triangles;
+};
+
+struct RiverGeometry {
+  // One entry per chunk. Chunks that weren't dirty are left empty.
+  std::vector<RiverChunkGeometry> chunks;
+  std::vector<bool> dirty_chunks;
+  // Every bank vertex, a row of contours per track position, relative to the
+  // river. Kept so the next build can tell which rows it has changed.
+  std::vector<vec3_packed> bank_positions;
+};
+
+// A river being generated on the worker thread, and then uploaded on the
+// render thread.
+struct RiverBuild {
+  RiverBuild() : wait(false), finished(false), uploaded(false) {}
+  corgi::EntityRef entity;
+  RiverBuildInput input;
+  RiverGeometry geometry;
+  // The uploaded water and bank mesh of each chunk, or null for chunks that
+  // weren't dirty.
+  std::vector<Mesh*> river_meshes;
+  std::vector<Mesh*> bank_meshes;
+  // Whether the update thread should wait for the build to be generated
+  // rather than carry on with the river as it was.
+  bool wait;
+  // Set by the worker thread once `geometry` is complete.
+  bool finished;
+  // Set by the render thread once the meshes are uploaded.
+  bool uploaded;
+};
+
+static void BuildRiverGeometry(const RiverBuildInput& input,
+                               RiverGeometry* geometry);
+static bool LoadRiverCache(const RiverBuildInput& input,
+                           RiverGeometry* geometry);
+static void SaveRiverCache(const RiverBuildInput& input,
+                           const RiverGeometry& geometry);
+
+// Generates the random bank offsets. Each river has its own, so the same seed
+// always gives the same river, no matter what else is using rand(), or which
+// thread the river is generated on.
+class RiverRandom {
+ public:
+  explicit RiverRandom(unsigned int seed) : state_(seed) {}
+
+  // Return a value in [0, 1).
+  float Next() {
+    state_ = state_ * 1664525u + 1013904223u;
+    return static_cast<float>(state_ >> 8) * (1.0f / 16777216.0f);
+  }
+
+  // Skip the next `count` values.
+  void Skip(size_t count) {
+    for (size_t i = 0; i < count; ++i) Next();
+  }
+
+  // Passing this to the constructor continues the sequence from here.
+  uint32_t state() const { return state_; }
+
+ private:
+  uint32_t state_;
+};
+
+// 64-bit FNV-1a hash, used to tell whether a cached river was generated from
+// the same inputs.
+class RiverHash {
+ public:
+  RiverHash() : hash_(14695981039346656037ull) {}
+
+  void Add(const void* data, size_t size) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; ++i) {
+      hash_ = (hash_ ^ bytes[i]) * 1099511628211ull;
+    }
+  }
+  void Add(uint32_t value) { Add(&value, sizeof(value)); }
+  void Add(float value) { Add(&value, sizeof(value)); }
+  void Add(const char* string) { Add(string, strlen(string) + 1); }
+  void Add(const RiverBankContour* contour) {
+    Add(contour->x_min());
+    Add(contour->x_max());
+    Add(contour->z_min());
+    Add(contour->z_max());
+  }
+
+  uint64_t hash() const { return hash_; }
+
+ private:
+  uint64_t hash_;
+};
+
+// Identifies river cache files, and the layout of their contents. Bump the
+// version whenever the generated geometry or the layout changes.
+static const uint32_t kRiverCacheMagic = 0x52565243;  // "CRVR"
+static const uint32_t kRiverCacheVersion = 3;
+
+// Cache files are kept in the same directory as the save data.
+static const char kRiverCacheAppName[] = "zooshi";
+
+struct RiverCacheHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t hash;
+  uint32_t num_chunks;
+  uint32_t num_zones;
+};
+
+// Track positions and bank vertices this close together are treated as
+// unchanged.
+static const float kTrackEpsilon = 1e-4f;
+
+// Number of segments to put in each chunk of a river, so that a chunk and the
+// extra segment on either side used to compute its normals stay within range
+// of 16-bit indices.
+static size_t ChunkSegments(const RiverConfig* river) {
+  const size_t num_bank_contours = river->default_banks()->Length();
+  const size_t max_chunk_segments = kMaxChunkVertices / num_bank_contours - 3;
+  return std::max<size_t>(
+      1, std::min(static_cast<size_t>(
+                      std::max(river->chunk_segment_count(), 1)),
+                  max_chunk_segments));
+}
+
+// Number of chunks a river of `segment_count` track positions is split into.
+// Neighbouring chunks share a row, so each one after the first adds
+// `chunk_segments` rows.
+static size_t NumChunks(size_t segment_count, size_t chunk_segments) {
+  return (segment_count - 2) / chunk_segments + 1;
+}
+
+RiverComponent::RiverComponent()
+    : river_offset_(0.0f),
+      build_thread_(nullptr),
+      build_mutex_(SDL_CreateMutex()),
+      build_cond_(SDL_CreateCond()),
+      quit_build_thread_(false) {}
+
+RiverComponent::~RiverComponent() {
+  // Don't leave the worker thread writing into builds that no longer exist.
+  // It finishes the build it's on, and drops the rest of the queue.
+  if (build_thread_ != nullptr) {
+    SDL_LockMutex(build_mutex_);
+    quit_build_thread_ = true;
+    SDL_CondBroadcast(build_cond_);
+    SDL_UnlockMutex(build_mutex_);
+    SDL_WaitThread(build_thread_, nullptr);
+  }
+  SDL_DestroyCond(build_cond_);
+  SDL_DestroyMutex(build_mutex_);
+}
+
 void RiverComponent::Init() {
   auto services = entity_manager_->GetComponent<ServicesComponent>();
   SceneLab* scene_lab = services->scene_lab();
   if (scene_lab) {
     scene_lab->AddOnUpdateEntityCallback(
-        [this](const scene_lab::GenericEntityId& /*entity*/) {
-          TriggerRiverUpdate();
+        [this](const scene_lab::GenericEntityId& id) {
+          // Use CorgiAdapter to convert GenericEntityId to corgi::EntityRef.
+          corgi::EntityRef entity =
+              static_cast<scene_lab_corgi::CorgiAdapter*>(
+                  entity_manager_->GetComponent<ServicesComponent>()
+                      ->scene_lab()
+                      ->entity_system_adapter())
+                  ->GetEntityRef(id);
+          OnEntityUpdated(entity);
         });
   }
   river_offset_ = 0;
@@ -100,15 +323,45 @@ void RiverComponent::UpdateAllEntities(corgi::WorldTime /*delta_time*/) {
 }
 
 void RiverComponent::TriggerRiverUpdate() {
-  // TODO - it would be nice if this only updated the river that we were editing
-  // (instead of marking all rivers as needing an update) but due to how river
-  // edit nodes interact with the river mesh, that's tricky.
   for (auto iter = begin(); iter != end(); ++iter) {
     RiverData* river_data = Data<RiverData>(iter->entity);
     river_data->render_mesh_needs_update_ = true;
   }
 }
 
+void RiverComponent::TriggerRiverUpdate(const std::string& rail_name) {
+  for (auto iter = begin(); iter != end(); ++iter) {
+    RiverData* river_data = Data<RiverData>(iter->entity);
+    if (river_data->rail_name == rail_name) {
+      river_data->render_mesh_needs_update_ = true;
+    }
+  }
+}
+
+// Only rivers whose rail was edited need to be regenerated. Which parts of
+// them actually changed is worked out from the rail's nodes when they're
+// rebuilt.
+void RiverComponent::OnEntityUpdated(corgi::EntityRef entity) {
+  while (entity.IsValid()) {
+    const RailNodeData* node_data =
+        entity_manager_->GetComponentData<RailNodeData>(entity);
+    if (node_data != nullptr) {
+      TriggerRiverUpdate(node_data->rail_name);
+      return;
+    }
+    RiverData* river_data = GetComponentData(entity);
+    if (river_data != nullptr) {
+      // The river itself was edited, so its seed may have changed.
+      river_data->built_track.clear();
+      river_data->render_mesh_needs_update_ = true;
+      return;
+    }
+    const TransformData* transform_data = Data<TransformData>(entity);
+    if (transform_data == nullptr) return;
+    entity = transform_data->parent;
+  }
+}
+
 corgi::ComponentInterface::RawDataUniquePtr RiverComponent::ExportRawData(
     const corgi::EntityRef& entity) const {
   const RiverData* data = GetComponentData(entity);
@@ -129,89 +382,480 @@ corgi::ComponentInterface::RawDataUniquePtr RiverComponent::ExportRawData(
 }
 
 // Iterate through the river meshes and update any of them that need to be
-// regenerated.  Split out into a separate function so it can be called from
-// the render thread.  (Warning:  Crashes if you try to call it on the main
-// thread, because it doesn't have access to the opengl context!)
+// regenerated. The geometry is generated on a worker thread, and uploaded by
+// UploadRiverMeshes on the render thread, so this starts generating any
+// rivers that have changed, and puts the meshes of the rivers that have been
+// uploaded in place.
 void RiverComponent::UpdateRiverMeshes() {
   PushDebugMarker("UpdateRiverMeshes");
+  // Rivers that change while they're being generated are started again once
+  // the build in flight has been applied.
   for (auto iter = begin(); iter != end(); ++iter) {
     RiverData* river_data = Data<RiverData>(iter->entity);
-    if (river_data->render_mesh_needs_update_) CreateRiverMesh(iter->entity);
+    if (river_data->render_mesh_needs_update_ && !IsBuilding(iter->entity)) {
+      StartRiverBuild(iter->entity);
+    }
+  }
+
+  for (size_t i = 0; i < builds_.size();) {
+    RiverBuild* build = builds_[i].get();
+    if (build->wait) WaitForRiverBuild(build);
+    SDL_LockMutex(build_mutex_);
+    const bool uploaded = build->uploaded;
+    SDL_UnlockMutex(build_mutex_);
+    if (!uploaded) {
+      ++i;
+      continue;
+    }
+    // The river may have been deleted while it was being generated.
+    if (build->entity.IsValid() && GetComponentData(build->entity)) {
+      ApplyRiverGeometry(build->entity, build);
+    } else {
+      WorldRenderer* world_renderer =
+          entity_manager_->GetComponent<ServicesComponent>()
+              ->world()
+              ->world_renderer;
+      for (size_t c = 0; c < build->river_meshes.size(); ++c) {
+        if (build->river_meshes[c] != nullptr) {
+          world_renderer->RetireMesh(build->river_meshes[c]);
+          world_renderer->RetireMesh(build->bank_meshes[c]);
+        }
+      }
+    }
+    builds_.erase(builds_.begin() + i);
   }
   PopDebugMarker();
 }
 
-// Generates the actual mesh for the river, and adds it to this entitiy's
-// rendermesh component.
-void RiverComponent::CreateRiverMesh(corgi::EntityRef& entity) {
-  static const fplbase::Attribute kMeshFormat[] = {
-      fplbase::kPosition3f, fplbase::kTexCoord2f, fplbase::kNormal3f,
-      fplbase::kTangent4f, fplbase::kEND};
-  static const fplbase::Attribute kBankMeshFormat[] = {
-      fplbase::kPosition3f, fplbase::kTexCoord2f, fplbase::kNormal3f,
-      fplbase::kTangent4f,  fplbase::kColor4ub,   fplbase::kEND};
-  std::vector<vec3_packed> track;
-  const RiverConfig* river = entity_manager_->GetComponent<ServicesComponent>()
-                                 ->world()
-                                 ->CurrentLevel()
-                                 ->river_config();
+static void UploadRiverGeometry(RiverBuild* build);
+
+void RiverComponent::UploadRiverMeshes() {
+  std::vector<RiverBuild*> uploads;
+  SDL_LockMutex(build_mutex_);
+  uploads.swap(upload_queue_);
+  SDL_UnlockMutex(build_mutex_);
+  if (uploads.empty()) return;
+
+  PushDebugMarker("UploadRiverMeshes");
+  for (auto build = uploads.begin(); build != uploads.end(); ++build) {
+    UploadRiverGeometry(*build);
+  }
+  SDL_LockMutex(build_mutex_);
+  for (auto build = uploads.begin(); build != uploads.end(); ++build) {
+    (*build)->uploaded = true;
+  }
+  SDL_UnlockMutex(build_mutex_);
+  PopDebugMarker();
+}
+
+bool RiverComponent::IsBuilding(const corgi::EntityRef& entity) const {
+  for (auto build = builds_.begin(); build != builds_.end(); ++build) {
+    if ((*build)->entity == entity) return true;
+  }
+  return false;
+}
+
+// Generate the geometry for `build`, or load it from the cache. Only touches
+// the build itself, so it can run on any thread.
+static void GenerateRiver(RiverBuild* build) {
+  const RiverBuildInput& input = build->input;
+  if (input.cache_filename.empty()) {
+    BuildRiverGeometry(input, &build->geometry);
+  } else if (!LoadRiverCache(input, &build->geometry)) {
+    BuildRiverGeometry(input, &build->geometry);
+    SaveRiverCache(input, build->geometry);
+  }
+}
+
+void RiverComponent::QueueRiverBuild(RiverBuild* build) {
+  SDL_LockMutex(build_mutex_);
+  if (build_thread_ == nullptr) {
+    build_thread_ =
+        SDL_CreateThread(BuildThreadMain, "Zooshi River Build", this);
+  }
+  if (build_thread_ == nullptr) {
+    SDL_UnlockMutex(build_mutex_);
+    fplbase::LogError("RiverComponent: Couldn't create thread: %s",
+                      SDL_GetError());
+    GenerateRiver(build);
+    SDL_LockMutex(build_mutex_);
+    build->finished = true;
+    upload_queue_.push_back(build);
+    SDL_UnlockMutex(build_mutex_);
+    return;
+  }
+  build_queue_.push_back(build);
+  SDL_CondBroadcast(build_cond_);
+  SDL_UnlockMutex(build_mutex_);
+}
+
+void RiverComponent::WaitForRiverBuild(RiverBuild* build) {
+  SDL_LockMutex(build_mutex_);
+  while (!build->finished) SDL_CondWait(build_cond_, build_mutex_);
+  SDL_UnlockMutex(build_mutex_);
+}
+
+int RiverComponent::BuildThreadMain(void* data) {
+  static_cast<RiverComponent*>(data)->RunRiverBuilds();
+  return 0;
+}
+
+void RiverComponent::RunRiverBuilds() {
+  SDL_LockMutex(build_mutex_);
+  for (;;) {
+    while (build_queue_.empty() && !quit_build_thread_) {
+      SDL_CondWait(build_cond_, build_mutex_);
+    }
+    if (quit_build_thread_) break;
+    RiverBuild* build = build_queue_.front();
+    build_queue_.pop_front();
+    SDL_UnlockMutex(build_mutex_);
+
+    GenerateRiver(build);
+
+    SDL_LockMutex(build_mutex_);
+    build->finished = true;
+    upload_queue_.push_back(build);
+    SDL_CondBroadcast(build_cond_);
+  }
+  SDL_UnlockMutex(build_mutex_);
+}
+
+// Hash everything that goes into generating the river, so that a cached river
+// is only used if generating it again would give the same geometry.
+static uint64_t HashRiverInput(const RiverBuildInput& input) {
+  const RiverConfig* river = input.river;
+  RiverHash hash;
+  hash.Add(kRiverCacheVersion);
+  hash.Add(static_cast<uint32_t>(input.random_seed));
+  hash.Add(static_cast<uint32_t>(input.wraps));
+  hash.Add(static_cast<uint32_t>(input.chunk_segments));
+  hash.Add(static_cast<uint32_t>(input.track.size()));
+  hash.Add(input.track.data(), input.track.size() * sizeof(vec3_packed));
+  for (size_t i = 0; i < input.single_texture_zones.size(); ++i) {
+    hash.Add(static_cast<uint32_t>(input.single_texture_zones[i]));
+  }
+  hash.Add(river->track_height());
+  hash.Add(river->texture_tile_size());
+  hash.Add(river->default_width());
+  hash.Add(static_cast<uint32_t>(river->river_index()));
+  hash.Add(static_cast<uint32_t>(river->collision_segment_stride()));
+  const uint32_t num_collision_contours =
+      river->collision_contours() ? river->collision_contours()->Length() : 0;
+  hash.Add(num_collision_contours);
+  for (uint32_t i = 0; i < num_collision_contours; ++i) {
+    hash.Add(static_cast<uint32_t>(river->collision_contours()->Get(i)));
+  }
+  hash.Add(static_cast<uint32_t>(river->default_banks()->Length()));
+  for (uint32_t i = 0; i < river->default_banks()->Length(); ++i) {
+    hash.Add(river->default_banks()->Get(i));
+  }
+  hash.Add(static_cast<uint32_t>(river->zones()->Length()));
+  for (uint32_t z = 0; z < river->zones()->Length(); ++z) {
+    const RiverZone* zone = river->zones()->Get(z);
+    hash.Add(zone->zone_start());
+    hash.Add(zone->width());
+    const uint32_t num_banks = zone->banks() ? zone->banks()->Length() : 0;
+    hash.Add(num_banks);
+    for (uint32_t i = 0; i < num_banks; ++i) {
+      hash.Add(zone->banks()->Get(i));
+    }
+  }
+  return hash.hash();
+}
+
+// Gather everything needed to generate the river, and hand it to the worker
+// thread.
+void RiverComponent::StartRiverBuild(corgi::EntityRef& entity) {
+  ServicesComponent* services =
+      entity_manager_->GetComponent<ServicesComponent>();
+  const RiverConfig* river = services->world()->CurrentLevel()->river_config();
+  fplbase::AssetManager* asset_manager = services->asset_manager();
 
   RiverData* river_data = Data<RiverData>(entity);
   river_data->render_mesh_needs_update_ = false;
 
-  // Initialize the static mesh that will be made around the river banks.
-  auto* physics_component = entity_manager_->GetComponent<PhysicsComponent>();
-  physics_component->InitStaticMesh(entity);
+  Rail* rail = services->rail_manager()->GetRailFromComponents(
+      river_data->rail_name.c_str(), entity_manager_);
+
+  std::unique_ptr<RiverBuild> build(new RiverBuild());
+  build->entity = entity;
+  RiverBuildInput& input = build->input;
+  input.river = river;
+  input.wraps = rail->wraps();
+
+  // Sample the track between each pair of rail nodes separately, at fixed
+  // fractions of the time between them. Moving a node retimes the whole
+  // rail, so samples taken at fixed times along it would all move, but it
+  // only reshapes the spans next to it. The number of samples in each span
+  // is kept from the last build, so that the rows and chunks of the river
+  // stay where they were.
+  input.chunk_segments = ChunkSegments(river);
+  const std::vector<vec3_packed>& nodes = rail->node_positions();
+  const std::vector<float>& node_times = rail->node_times();
+  const size_t num_spans = nodes.empty() ? 0 : nodes.size() - 1;
+  std::vector<size_t>& span_segments = river_data->built_span_segments;
+  const bool same_spans =
+      river_data->built_nodes.size() == nodes.size() &&
+      river_data->built_chunk_segments == input.chunk_segments &&
+      !river_data->built_track.empty();
+  if (!same_spans) {
+    span_segments.resize(num_spans);
+    for (size_t k = 0; k < num_spans; ++k) {
+      const float span_time = node_times[k + 1] - node_times[k];
+      span_segments[k] = std::max<size_t>(
+          1, static_cast<size_t>(span_time / river->spline_stepsize() + 0.5f));
+    }
+  }
+  for (size_t k = 0; k < num_spans; ++k) {
+    const float step = (node_times[k + 1] - node_times[k]) /
+                       static_cast<float>(span_segments[k]);
+    for (size_t m = 0; m < span_segments[k]; ++m) {
+      input.track.push_back(rail->PositionCalculatedSlowly(
+          node_times[k] + step * static_cast<float>(m)));
+    }
+  }
+  input.track.push_back(rail->PositionCalculatedSlowly(rail->EndTime()));
+  const size_t segment_count = input.track.size();
+
+  // If the number of nodes or chunks has changed, everything along the river
+  // shifts, so regenerate all of it.
+  const size_t num_chunks = NumChunks(segment_count, input.chunk_segments);
+  const std::vector<vec3_packed>& built_track = river_data->built_track;
+  const bool rebuild_all = !same_spans ||
+                           built_track.size() != segment_count ||
+                           river_data->chunks.size() < num_chunks ||
+                           river_data->built_bank_positions.empty();
+  if (!rebuild_all) {
+    // A node's position feeds the rail's direction at the nodes either side,
+    // so moving it reshapes the spans up to one node away.
+    std::vector<bool> moved_nodes(nodes.size());
+    for (size_t n = 0; n < nodes.size(); ++n) {
+      moved_nodes[n] = (vec3(nodes[n]) - vec3(river_data->built_nodes[n]))
+                           .LengthSquared() > kTrackEpsilon * kTrackEpsilon;
+    }
+    std::vector<bool> moved_spans(num_spans);
+    for (size_t k = 0; k < num_spans; ++k) {
+      const size_t first = k > 0 ? k - 1 : 0;
+      const size_t last = std::min(k + 2, num_spans);
+      for (size_t n = first; n <= last; ++n) {
+        if (moved_nodes[n]) moved_spans[k] = true;
+      }
+    }
+    // Each span's first row is at its node. Rows elsewhere on spans that
+    // weren't reshaped keep their positions exactly, rather than picking up
+    // the rounding of the retimed rail.
+    input.moved_track.resize(segment_count);
+    size_t row = 0;
+    for (size_t k = 0; k < num_spans; ++k) {
+      for (size_t m = 0; m < span_segments[k]; ++m, ++row) {
+        input.moved_track[row] = m == 0 ? moved_nodes[k] : moved_spans[k];
+      }
+    }
+    input.moved_track[row] = moved_nodes[num_spans];
+    for (size_t i = 0; i < segment_count; ++i) {
+      if (!input.moved_track[i]) input.track[i] = built_track[i];
+    }
+    // Replaced with the new positions once the build is applied.
+    input.built_bank_positions.swap(river_data->built_bank_positions);
+  }
+  river_data->built_nodes = nodes;
+  river_data->built_track = input.track;
+  river_data->built_chunk_segments = input.chunk_segments;
+
+  // Loading materials would touch GL, so they're only looked up here. The
+  // river's materials are loaded with the rest of the asset manifest.
+  input.river_material =
+      asset_manager->FindMaterial(river->material()->c_str());
+  if (input.river_material == nullptr) {
+    fplbase::LogError("RiverComponent: Material %s isn't loaded",
+                      river->material()->c_str());
+  }
+  const unsigned int num_zones = river->zones()->Length();
+  input.single_texture_zones.resize(num_zones);
+  input.bank_materials.resize(num_zones);
+  for (unsigned int zone = 0; zone < num_zones; zone++) {
+    const char* material_name = river->zones()->Get(zone)->material()->c_str();
+    Material* material = asset_manager->FindMaterial(material_name);
+    if (material == nullptr) {
+      fplbase::LogError("RiverComponent: Material %s isn't loaded",
+                        material_name);
+      continue;
+    }
+    input.single_texture_zones[zone] = material->textures().size() == 1;
+    input.bank_materials[zone] = BankMaterial(material);
+  }
+
+  input.random_seed = river_data->random_seed;
+  input.hash = HashRiverInput(input);
+
+  // Whole rivers are cached, so that loading a level doesn't have to generate
+  // them again. Each river keeps one cache file, named for its rail and seed,
+  // which is overwritten whenever the river changes.
+  std::string storage_path;
+  if (rebuild_all && fplbase::GetStoragePath(kRiverCacheAppName,
+                                             &storage_path)) {
+    RiverHash name_hash;
+    name_hash.Add(river_data->rail_name.c_str());
+    name_hash.Add(static_cast<uint32_t>(river_data->random_seed));
+    char filename[64];
+    snprintf(filename, sizeof(filename), "river_%016llx.bin",
+             static_cast<unsigned long long>(name_hash.hash()));
+    input.cache_filename = storage_path + filename;
+  }
+
+  // A river's first build happens while its level loads, and the level
+  // shouldn't start without it. Later builds come from Scene Lab edits, and
+  // the old meshes are drawn until they're done. Either way, the meshes are
+  // put in place a frame or two later, once the render thread has uploaded
+  // them.
+  build->wait = river_data->chunks.empty();
+  QueueRiverBuild(build.get());
+  builds_.push_back(std::move(build));
+}
+
+// Computes the normals and tangents of `num_rows` rows of bank vertices,
+// starting at row `first_row` of the river, from the grid that the bank
+// `positions` of the whole river form, instead of from their triangles. Each
+// row of `num_contours` positions is one track position. The two banks are
+// separate surfaces, so differences across the track never reach over the
+// river. Vertices are handled one at a time; only the vec3 arithmetic within
+// a vertex uses SIMD, when mathfu is built with it.
+static void ComputeBankNormalsTangents(const vec3_packed* positions,
+                                       size_t river_rows, size_t num_contours,
+                                       size_t river_idx, bool wraps,
+                                       size_t first_row, size_t num_rows,
+                                       NormalMappedColorVertex* verts) {
+  for (size_t r = 0; r < num_rows; ++r) {
+    const size_t i = first_row + r;
+    // The last row of a circular river is a copy of the first.
+    const size_t prev_row = i > 0 ? i - 1 : (wraps ? river_rows - 2 : i);
+    const size_t next_row = i + 1 < river_rows ? i + 1 : (wraps ? 1 : i);
+    const vec3_packed* prev = &positions[prev_row * num_contours];
+    const vec3_packed* next = &positions[next_row * num_contours];
+    const vec3_packed* row_positions = &positions[i * num_contours];
+    NormalMappedColorVertex* row = &verts[r * num_contours];
+    for (size_t j = 0; j < num_contours; ++j) {
+      const size_t side_first = j <= river_idx ? 0 : river_idx + 1;
+      const size_t side_last = j <= river_idx ? river_idx : num_contours - 1;
+      const size_t left = j > side_first ? j - 1 : j;
+      const size_t right = j < side_last ? j + 1 : j;
+
+      const vec3 along = vec3(next[j]) - vec3(prev[j]);
+      const vec3 across =
+          vec3(row_positions[right]) - vec3(row_positions[left]);
+      vec3 normal = vec3::CrossProduct(across, along);
+      const float normal_length = normal.Length();
+      normal = normal_length > 0.0f ? normal / normal_length : kAxisZ3f;
+
+      // The tangent points along increasing u, which runs across the bank.
+      // v always increases along the track, so `along` is the bitangent.
+      const float du = vec2(row[right].tc).x - vec2(row[left].tc).x;
+      vec3 tangent = du < 0.0f ? -across : across;
+      tangent -= normal * vec3::DotProduct(normal, tangent);
+      const float tangent_length = tangent.Length();
+      tangent = tangent_length > 0.0f ? tangent / tangent_length
+                                      : vec3::CrossProduct(along, normal)
+                                            .Normalized();
+      const float handedness =
+          vec3::DotProduct(vec3::CrossProduct(normal, tangent), along) < 0.0f
+              ? -1.0f
+              : 1.0f;
 
-  Rail* rail = entity_manager_->GetComponent<ServicesComponent>()
-                   ->rail_manager()
-                   ->GetRailFromComponents(river_data->rail_name.c_str(),
-                                           entity_manager_);
+      row[j].norm = normal;
+      row[j].tangent = vec4(tangent, handedness);
+    }
+  }
+}
+
+#if ZOOSHI_BENCHMARK_RIVER_NORMALS
+// Log the time taken to compute the bank normals of every generated chunk,
+// both from the grid and from the chunk's triangles.
+static void BenchmarkBankNormals(const std::vector<vec3_packed>& positions,
+                                 const RiverGeometry& geometry,
+                                 size_t num_contours, size_t river_idx,
+                                 size_t chunk_segments, bool wraps) {
+  const size_t river_rows = positions.size() / num_contours;
+  const double ticks_to_ms =
+      1000.0 / static_cast<double>(SDL_GetPerformanceFrequency());
+  double analytic_ms = 0.0;
+  double generic_ms = 0.0;
+  size_t num_verts = 0;
+
+  std::vector<NormalMappedColorVertex> verts;
+  std::vector<unsigned short> indices;
+  for (size_t c = 0; c < geometry.chunks.size(); ++c) {
+    if (!geometry.dirty_chunks[c]) continue;
+    const std::vector<NormalMappedColorVertex>& bank_verts =
+        geometry.chunks[c].bank_verts;
+    const size_t num_rows = bank_verts.size() / num_contours;
+    num_verts += bank_verts.size();
 
-  // Generate the spline data and store it in our track vector:
-  rail->Positions(river->spline_stepsize(), &track);
+    verts = bank_verts;
+    Uint64 start = SDL_GetPerformanceCounter();
+    ComputeBankNormalsTangents(positions.data(), river_rows, num_contours,
+                               river_idx, wraps, c * chunk_segments, num_rows,
+                               verts.data());
+    analytic_ms +=
+        static_cast<double>(SDL_GetPerformanceCounter() - start) * ticks_to_ms;
 
-  fplbase::AssetManager* asset_manager =
-      entity_manager_->GetComponent<ServicesComponent>()->asset_manager();
+    // The generic solver only sees the chunk's own triangles.
+    verts = bank_verts;
+    indices.clear();
+    for (size_t i = 0; i + 1 < num_rows; ++i) {
+      for (size_t j = 0; j + 1 < num_contours; ++j) {
+        if (j == river_idx) continue;
+        const size_t base = i * num_contours + j;
+        const size_t quad[] = {base,
+                               base + 1,
+                               base + num_contours,
+                               base + num_contours,
+                               base + 1,
+                               base + num_contours + 1};
+        for (size_t k = 0; k < 6; ++k) {
+          indices.push_back(static_cast<unsigned short>(quad[k]));
+        }
+      }
+    }
+    start = SDL_GetPerformanceCounter();
+    Mesh::ComputeNormalsTangents(verts.data(), indices.data(),
+                                 static_cast<int>(verts.size()),
+                                 static_cast<int>(indices.size()));
+    generic_ms +=
+        static_cast<double>(SDL_GetPerformanceCounter() - start) * ticks_to_ms;
+  }
 
+  fplbase::LogInfo(
+      "RiverComponent: %d bank vertices, normals from grid %.3fms, from "
+      "triangles %.3fms",
+      static_cast<int>(num_verts), analytic_ms, generic_ms);
+}
+#endif  // ZOOSHI_BENCHMARK_RIVER_NORMALS
+
+// Generates the geometry for the river. Only reads from `input`, so it's safe
+// to call from any thread. When `input` says which track positions have moved
+// since the last build, only the chunks that depend on them are generated.
+static void BuildRiverGeometry(const RiverBuildInput& input,
+                               RiverGeometry* geometry) {
+  const RiverConfig* river = input.river;
+  const std::vector<vec3_packed>& track = input.track;
   const size_t num_bank_contours = river->default_banks()->Length();
   const size_t num_bank_quads = num_bank_contours - 2;
   const size_t river_idx = river->river_index();
   const size_t segment_count = track.size();
-  const size_t river_vert_max = segment_count * 2;
-  const size_t river_index_max = (segment_count - 1) * kNumIndicesPerQuad;
-  const size_t bank_vert_max = segment_count * num_bank_contours;
-  const size_t bank_index_max =
-      (segment_count - 1) * kNumIndicesPerQuad * num_bank_quads;
   assert(num_bank_contours >= 2 && river_idx < num_bank_contours - 1);
+  assert(segment_count >= 2);
   const unsigned int num_zones = river->zones()->Length();
-
-  // Need to allocate some space to plan out our mesh in:
-  std::vector<NormalMappedVertex> river_verts(river_vert_max);
-  river_verts.clear();
-  std::vector<unsigned short> river_indices(river_index_max);
-  river_indices.clear();
-
-  std::vector<NormalMappedColorVertex> bank_verts(bank_vert_max);
-  bank_verts.clear();
-  std::vector<unsigned short> bank_indices(bank_index_max);
-  bank_indices.clear();
-  // Use one set of bank vertices for the entire riverbank, but separate out
-  // the zones via indices, so we can use different materials (and possibly
-  // shaders) per zone. We still keep bank_indices for the normal calculation,
-  // though.
-  std::vector<std::vector<unsigned short>> bank_indices_by_zone;
-  bank_indices_by_zone.resize(num_zones);
+  const bool rebuild_all = input.moved_track.empty();
+  const std::vector<vec3_packed>& built_positions = input.built_bank_positions;
+  assert(rebuild_all ||
+         (input.moved_track.size() == segment_count &&
+          built_positions.size() == segment_count * num_bank_contours));
 
   std::vector<unsigned int> bank_zones;  // indexed by segment
   bank_zones.resize(segment_count, 0);   // default of 0
   unsigned int zone_id = 0;
 
-  // TODO: Use a local random number generator. Resetting the global random
-  //       number generator is not a nice. Also, there's no guarantee that
-  //       mathfu::Random will continue to use rand().
-  srand(river_data->random_seed);
-
   std::vector<float> actual_zone_end;
   actual_zone_end.resize(segment_count, 1);
   // Precalculate the actual zone end locations.
@@ -227,282 +871,563 @@ void RiverComponent::CreateRiverMesh(corgi::EntityRef& entity) {
   // Start over from zone 0.
   zone_id = 0;
 
-  const RiverZone* current_zone = river->zones()->Get(zone_id);
-  Material* current_bank_material =
-      asset_manager->LoadMaterial(current_zone->material()->c_str());
-  float river_width = current_zone->width() != 0 ? current_zone->width()
-                                                 : river->default_width();
-
-  // Construct the actual mesh data for the river:
-  std::vector<vec2> offsets(num_bank_contours);
+  // Work out which zone each segment is in, and how far through it.
+  std::vector<unsigned char> zone_colors(segment_count);
   for (size_t i = 0; i < segment_count; i++) {
-    // Get the current position on the track, and the normal (to the side).
-    vec3 track_delta;
-    if (i > 0) {
-      track_delta = vec3(track[i]) - vec3(track[i - 1]);
-    } else if (rail->wraps()) {
-      // River track is circular.
-      track_delta = vec3(track[i]) - vec3(track[segment_count - 1]);
-    } else {
-      // Not circular, so point towards the next point.
-      track_delta = vec3(track[1]) - vec3(track[0]);
-    }
-    const vec3 track_normal =
-        vec3::CrossProduct(track_delta, kAxisZ3f).Normalized();
-    const vec3 track_position =
-        vec3(track[i]) + river->track_height() * kAxisZ3f;
-
-    // The river texture is tiled several times along the course of the river.
-    // TODO: Change this from tile count to actual physical size for a tile.
-    //       Requires that we know the total path distance.
-    const float texture_v = river->texture_tile_size() * static_cast<float>(i) /
-                            static_cast<float>(segment_count);
-
     // Fraction of the river we have gone through, approximately.
     const float fraction =
         static_cast<float>(i) / static_cast<float>(segment_count);
 
     if (fraction >= actual_zone_end[zone_id]) {
       zone_id = zone_id + 1;
-      current_zone = river->zones()->Get(zone_id);
-      // Each zone has its own texture.
-      current_bank_material =
-          asset_manager->LoadMaterial(current_zone->material()->c_str());
-      // Each zone has its own river width.
-      river_width = current_zone->width() != 0 ? current_zone->width()
-                                               : river->default_width();
-      current_bank_material = asset_manager->LoadMaterial(
-          river->zones()->Get(zone_id)->material()->c_str());
     }
     bank_zones[i] = zone_id;
     float zone_start = zone_id == 0 ? 0 : actual_zone_end[zone_id - 1];
     float zone_end = actual_zone_end[zone_id];
     float within_fraction = (fraction - zone_start) / (zone_end - zone_start);
-    if (current_bank_material->textures().size() == 1) {
+    if (input.single_texture_zones[zone_id]) {
       // Ensure we stay continuous with transitional zones.
       within_fraction = within_fraction < 0.5f ? 1.0f : 0.0f;
     }
 
     int within_color = static_cast<int>(255.0 * within_fraction);
     // Cap the color to 0..255 byte.
-    unsigned char within_color_byte = static_cast<unsigned char>(
+    zone_colors[i] = static_cast<unsigned char>(
         within_color < 0 ? 0 : (within_color > 255 ? 255 : within_color));
+  }
 
-    // Get the (side, up) offsets of the bank vertices.
-    // The offsets are relative to `track_position`.
-    // side == distance along `track_normal`
-    // up == distance along kAxisZ3f
+  // The bank offsets of every segment come from one random sequence. Keep
+  // where each segment's part of it starts, so that its offsets can be made
+  // again without going through the segments before it.
+  std::vector<uint32_t> random_states(segment_count);
+  RiverRandom random(input.random_seed);
+  for (size_t i = 0; i < segment_count; i++) {
+    random_states[i] = random.state();
+    random.Skip(2 * num_bank_contours);
+  }
+
+  // Get the (side, up) offsets of the bank vertices of segment `i`.
+  // The offsets are relative to the track position.
+  // side == distance along the track normal
+  // up == distance along kAxisZ3f
+  auto bank_offsets = [&](size_t i, vec2* offsets) {
+    const RiverZone* zone = river->zones()->Get(bank_zones[i]);
+    RiverRandom segment_random(random_states[i]);
     for (size_t j = 0; j < num_bank_contours; ++j) {
       flatbuffers::uoffset_t index = static_cast<flatbuffers::uoffset_t>(j);
-      const RiverBankContour* b = (current_zone->banks() != nullptr)
-                                      ? current_zone->banks()->Get(index)
+      const RiverBankContour* b = (zone->banks() != nullptr)
+                                      ? zone->banks()->Get(index)
                                       : river->default_banks()->Get(index);
-      offsets[j] =
-          vec2(mathfu::Lerp(b->x_min(), b->x_max(), mathfu::Random<float>()),
-               mathfu::Lerp(b->z_min(), b->z_max(), mathfu::Random<float>()));
+      const float random_x = segment_random.Next();
+      const float random_z = segment_random.Next();
+      offsets[j] = vec2(mathfu::Lerp(b->x_min(), b->x_max(), random_x),
+                        mathfu::Lerp(b->z_min(), b->z_max(), random_z));
     }
+  };
+
+  // Get the direction of the track at segment `i`.
+  auto track_delta = [&](size_t i) -> vec3 {
+    if (i > 0) return vec3(track[i]) - vec3(track[i - 1]);
+    // River track is circular, and its last position is at its first.
+    if (input.wraps) return vec3(track[0]) - vec3(track[segment_count - 2]);
+    // Not circular, so point towards the next point.
+    return vec3(track[1]) - vec3(track[0]);
+  };
+
+  // Place every bank vertex. A segment only has to be placed again if its
+  // track position or the one before it moved, or if the segment before it
+  // was placed somewhere new, since no vertex may go behind the one before
+  // it. Other segments are where the last build left them.
+  std::vector<vec3_packed>& positions = geometry->bank_positions;
+  positions.resize(segment_count * num_bank_contours);
+  std::vector<bool> changed(segment_count, true);
+  std::vector<vec2> offsets(num_bank_contours);
+  for (size_t i = 0; i < segment_count; i++) {
+    vec3_packed* row = &positions[i * num_bank_contours];
+    if (!rebuild_all) {
+      const bool moved =
+          input.moved_track[i] ||
+          (i > 0 ? input.moved_track[i - 1] || changed[i - 1]
+                 : input.wraps && input.moved_track[segment_count - 2]);
+      if (!moved) {
+        std::copy(built_positions.begin() + i * num_bank_contours,
+                  built_positions.begin() + (i + 1) * num_bank_contours, row);
+        changed[i] = false;
+        continue;
+      }
+    }
+
+    // Get the current position on the track, and the normal (to the side).
+    const vec3 delta = track_delta(i);
+    const vec3 track_normal = vec3::CrossProduct(delta, kAxisZ3f).Normalized();
+    const vec3 track_position =
+        vec3(track[i]) + river->track_height() * kAxisZ3f;
+    // Each zone has its own river width.
+    const RiverZone* zone = river->zones()->Get(bank_zones[i]);
+    const float river_width =
+        zone->width() != 0 ? zone->width() : river->default_width();
 
-    // Create the bank vertices for this segment.
+    bank_offsets(i, offsets.data());
     for (size_t j = 0; j < num_bank_contours; ++j) {
       const bool left_bank = j <= river_idx;
       const vec2 off = offsets[j];
-      const vec3 vertex =
+      row[j] = vec3_packed(
           track_position +
           (off.x + river_width * (left_bank ? -1 : 1)) * track_normal +
-          off.y * kAxisZ3f;
-      // The texture is stretched from the side of the river to the far end
-      // of the bank. There are two banks, however, separated by the river.
-      // We need to know the width of the bank to caluate the `texture_u`
-      // coordinate.
-      const size_t bank_start = left_bank ? 0 : num_bank_contours - 1;
-      const size_t bank_end = left_bank ? river_idx : river_idx + 1;
-      const float bank_width = offsets[bank_start].x - offsets[bank_end].x;
-      const float texture_u = (off.x - offsets[bank_end].x) / bank_width;
-
-      bank_verts.push_back(NormalMappedColorVertex());
-      bank_verts.back().pos = vec3_packed(vertex);
-      bank_verts.back().tc = vec2_packed(vec2(texture_u, texture_v));
-      bank_verts.back().norm = vec3_packed(vec3(0, 1, 0));
-      bank_verts.back().tangent = vec4_packed(vec4(1, 0, 0, 1));
-      unsigned char color_bytes[4] = {255, 255, 255, within_color_byte};
-      memcpy(bank_verts.back().color, color_bytes, sizeof(color_bytes));
+          off.y * kAxisZ3f);
     }
 
     // Ensure vertices don't go behind previous vertices on the inside of
     // a tight corner.
     if (i > 0) {
-      const NormalMappedColorVertex* prev_verts =
-          &bank_verts[bank_verts.size() - 2 * num_bank_contours];
-      NormalMappedColorVertex* cur_verts =
-          &bank_verts[bank_verts.size() - num_bank_contours];
+      const vec3_packed* prev_row = row - num_bank_contours;
       for (size_t j = 0; j < num_bank_contours; j++) {
-        const vec3 vert_delta =
-            vec3(cur_verts[j].pos) - vec3(prev_verts[j].pos);
-        const float dot = vec3::DotProduct(vert_delta, track_delta);
+        const vec3 vert_delta = vec3(row[j]) - vec3(prev_row[j]);
+        const float dot = vec3::DotProduct(vert_delta, delta);
         const bool cur_vert_goes_backwards_along_track = dot <= 0.0f;
         if (cur_vert_goes_backwards_along_track) {
-          cur_verts[j].pos = vec3(prev_verts[j].pos) + 0.000001f * track_delta;
+          row[j] = vec3_packed(vec3(prev_row[j]) + 0.000001f * delta);
         }
       }
     }
 
-    // Force the beginning and end to line up in their geometry:
-    if (i == segment_count - 1 && rail->wraps()) {
-      for (size_t j = 0; j < num_bank_contours; j++)
-        bank_verts[bank_verts.size() - (8 - j)].pos = bank_verts[j].pos;
+    if (!rebuild_all) {
+      const vec3_packed* built_row = &built_positions[i * num_bank_contours];
+      bool row_changed = false;
+      for (size_t j = 0; j < num_bank_contours; j++) {
+        if ((vec3(row[j]) - vec3(built_row[j])).LengthSquared() >
+            kTrackEpsilon * kTrackEpsilon) {
+          row_changed = true;
+        }
+      }
+      changed[i] = row_changed;
     }
+  }
 
-    // The river has two of the middle vertices of the bank.
-    // The texture coordinates are different, however.
-    const size_t river_vert = bank_verts.size() - num_bank_contours + river_idx;
-    float normalized_texture_v = i / static_cast<float>(segment_count);
-    river_verts.push_back(NormalMappedVertex());
-    river_verts.back().pos = bank_verts[river_vert].pos;
-    river_verts.back().tc = vec2(0.0f, normalized_texture_v);
-    river_verts.back().norm = bank_verts[river_vert].norm;
-    river_verts.back().tangent = bank_verts[river_vert].tangent;
-
-    river_verts.push_back(NormalMappedVertex());
-    river_verts.back().pos = bank_verts[river_vert + 1].pos;
-    river_verts.back().tc = vec2(1.0f, normalized_texture_v);
-    river_verts.back().norm = bank_verts[river_vert + 1].norm;
-    river_verts.back().tangent = bank_verts[river_vert + 1].tangent;
-  }
-
-  // Not counting the first segment, create triangles in our index
-  // list to represent this segment.
-  //
-  for (size_t i = 0; i < segment_count - 1; i++) {
-    auto make_quad = [&](std::vector<unsigned short>& indices, int base_index,
-                         int off1, int off2) {
-      indices.push_back(static_cast<unsigned short>(base_index + off1));
-      indices.push_back(static_cast<unsigned short>(base_index + off1 + 1));
-      indices.push_back(static_cast<unsigned short>(base_index + off2));
-
-      indices.push_back(static_cast<unsigned short>(base_index + off2));
-      indices.push_back(static_cast<unsigned short>(base_index + off1 + 1));
-      indices.push_back(static_cast<unsigned short>(base_index + off2 + 1));
-    };
-
-    // River only has one quad per segment.
-    make_quad(river_indices, 2 * static_cast<int>(i), 0, 2);
-
-    // Case when kNumBankCountours = 8, and river_idx = 3;
+  // Force the beginning and end to line up in their geometry:
+  if (input.wraps) {
+    std::copy(positions.begin(), positions.begin() + num_bank_contours,
+              positions.end() - num_bank_contours);
+    changed[segment_count - 1] = changed[0];
+  }
+
+  auto make_quad = [](std::vector<unsigned short>& indices, size_t base_index,
+                      size_t off1, size_t off2) {
+    indices.push_back(static_cast<unsigned short>(base_index + off1));
+    indices.push_back(static_cast<unsigned short>(base_index + off1 + 1));
+    indices.push_back(static_cast<unsigned short>(base_index + off2));
+
+    indices.push_back(static_cast<unsigned short>(base_index + off2));
+    indices.push_back(static_cast<unsigned short>(base_index + off1 + 1));
+    indices.push_back(static_cast<unsigned short>(base_index + off2 + 1));
+  };
+
+  // The contours the collision mesh follows, skipping any that are out of
+  // range or out of order.
+  std::vector<size_t> collision_contours;
+  if (river->collision_contours() != nullptr) {
+    for (auto it = river->collision_contours()->begin();
+         it != river->collision_contours()->end(); ++it) {
+      const int contour = *it;
+      if (contour < 0 || contour >= static_cast<int>(num_bank_contours) ||
+          (!collision_contours.empty() &&
+           static_cast<size_t>(contour) <= collision_contours.back())) {
+        continue;
+      }
+      collision_contours.push_back(static_cast<size_t>(contour));
+    }
+  }
+  if (collision_contours.size() < 2) {
+    collision_contours.clear();
+    for (size_t j = 0; j < num_bank_contours; ++j) {
+      collision_contours.push_back(j);
+    }
+  }
+  const size_t collision_stride =
+      static_cast<size_t>(std::max(river->collision_segment_stride(), 1));
+
+  const size_t chunk_segments = input.chunk_segments;
+  const size_t num_chunks = NumChunks(segment_count, chunk_segments);
+  geometry->chunks.resize(num_chunks);
+
+  // A chunk's normals depend on the segments either side of it, so it has to
+  // be generated again if any segment from the one before it to the one
+  // after it has changed.
+  geometry->dirty_chunks.assign(num_chunks, rebuild_all);
+  for (size_t c = 0; c < num_chunks && !rebuild_all; ++c) {
+    const size_t first = c * chunk_segments;
+    const size_t last = std::min(first + chunk_segments, segment_count - 1);
+    const size_t before =
+        first > 0 ? first - 1 : (input.wraps ? segment_count - 2 : first);
+    const size_t after =
+        last + 1 < segment_count ? last + 1 : (input.wraps ? 1 : last);
+    bool dirty = changed[before] || changed[after];
+    for (size_t i = first; i <= last; ++i) {
+      if (changed[i]) dirty = true;
+    }
+    geometry->dirty_chunks[c] = dirty;
+  }
+
+  for (size_t c = 0; c < num_chunks; ++c) {
+    if (!geometry->dirty_chunks[c]) continue;
+    RiverChunkGeometry& chunk = geometry->chunks[c];
+    const size_t first = c * chunk_segments;
+    const size_t last = std::min(first + chunk_segments, segment_count - 1);
+
+    // Add triangles between every `collision_stride`th row of bank vertices
+    // to the chunk's static mesh, only following the collision contours.
+    // The chunk's last row is always used, so that chunks join up.
+    //
+    // Case when kNumBankCountours = 8, river_idx = 3, and every contour is
+    // used;
     //
     //  0___1___2___3   4___5___6___7
     //  | _/| _/| _/|   | _/| _/| _/|
     //  |/__|/__|/__|   |/__|/__|/__|
     //  8   9  10  11  12  13  14  15
-    for (size_t j = 0; j <= num_bank_quads; ++j) {
-      // Do not create bank geo for the river.
-      if (j == river_idx) continue;
-      unsigned int zone = bank_zones[i];
-      int base_index = static_cast<int>(i * num_bank_contours);
-      int offset1 = static_cast<int>(j);
-      int offset2 = static_cast<int>(num_bank_contours + j);
-      make_quad(bank_indices, base_index, offset1, offset2);
-      make_quad(bank_indices_by_zone[zone], base_index, offset1, offset2);
-
-      // Add the same triangles to the static mesh associated with the entity.
-      physics_component->AddStaticMeshTriangle(
-          entity, vec3(bank_verts[base_index + offset1].pos),
-          vec3(bank_verts[base_index + offset1 + 1].pos),
-          vec3(bank_verts[base_index + offset2].pos));
+    std::vector<vec3_packed>& collision = chunk.collision_triangles;
+    collision.clear();
+    for (size_t i = first; i < last;) {
+      const size_t next = std::min(i + collision_stride, last);
+      for (size_t k = 0; k + 1 < collision_contours.size(); ++k) {
+        const size_t j1 = collision_contours[k];
+        const size_t j2 = collision_contours[k + 1];
+        // Do not create bank geo for the river.
+        if (j1 <= river_idx && j2 > river_idx) continue;
+        const vec3_packed* row = &positions[i * num_bank_contours];
+        const vec3_packed* next_row = &positions[next * num_bank_contours];
+        collision.push_back(row[j1]);
+        collision.push_back(row[j2]);
+        collision.push_back(next_row[j1]);
 
-      physics_component->AddStaticMeshTriangle(
-          entity, vec3(bank_verts[base_index + offset2].pos),
-          vec3(bank_verts[base_index + offset1 + 1].pos),
-          vec3(bank_verts[base_index + offset2 + 1].pos));
-    }
-  }
-
-  // Make sure we used as much data as expected, and no more.
-  assert(river_indices.size() == river_index_max);
-  assert(river_verts.size() == river_vert_max);
-  assert(bank_indices.size() == bank_index_max);
-  assert(bank_verts.size() == bank_vert_max);
-
-  Mesh::ComputeNormalsTangents(bank_verts.data(), bank_indices.data(),
-                               static_cast<int>(bank_verts.size()),
-                               static_cast<int>(bank_indices.size()));
-
-  // Load the material from files.
-  Material* river_material =
-      asset_manager->LoadMaterial(river->material()->c_str());
-  // Create the actual mesh objects, and stuff all the data we just
-  // generated into it.
-  Mesh* river_mesh =
-      new Mesh(river_verts.data(), river_verts.size(),
-               static_cast<int>(sizeof(NormalMappedVertex)), kMeshFormat);
-
-  river_mesh->AddIndices(river_indices.data(),
-                         static_cast<int>(river_indices.size()),
-                         river_material);
-
-  // Add the river mesh to the river entity.
-  RenderMeshData* mesh_data = Data<RenderMeshData>(entity);
-  mesh_data->shaders.push_back(
-      asset_manager->LoadShader(river->shader()->c_str()));
-  mesh_data->shaders.push_back(
-      asset_manager->LoadShader("shaders/render_depth"));
-  if (mesh_data->mesh != nullptr) {
-    // Mesh's destructor handles cleaning up its GL buffers
-    delete mesh_data->mesh;
-    mesh_data->mesh = nullptr;
-  }
-  mesh_data->mesh = river_mesh;
-  mesh_data->culling_mask = 0;  // Never cull the river.
-  mesh_data->pass_mask = 1 << corgi::RenderPass_Opaque;
-  mesh_data->debug_name = "river";
-
-  river_data->banks.resize(num_zones, corgi::EntityRef());
-  for (unsigned int zone = 0; zone < num_zones; zone++) {
-    Material* bank_material = asset_manager->LoadMaterial(
-        river->zones()->Get(zone)->material()->c_str());
+        collision.push_back(next_row[j1]);
+        collision.push_back(row[j2]);
+        collision.push_back(next_row[j2]);
+      }
+      i = next;
+    }
 
-    Mesh* bank_mesh =
-        new Mesh(bank_verts.data(), static_cast<int>(bank_verts.size()),
-                 sizeof(NormalMappedColorVertex), kBankMeshFormat);
+    // Create the bank vertices for the chunk's segments.
+    std::vector<NormalMappedColorVertex>& bank_verts = chunk.bank_verts;
+    bank_verts.resize((last - first + 1) * num_bank_contours);
+    for (size_t i = first; i <= last; i++) {
+      // The river texture is tiled several times along the course of the
+      // river.
+      // TODO: Change this from tile count to actual physical size for a tile.
+      //       Requires that we know the total path distance.
+      const float texture_v = river->texture_tile_size() *
+                              static_cast<float>(i) /
+                              static_cast<float>(segment_count);
+      bank_offsets(i, offsets.data());
+      const vec3_packed* row = &positions[i * num_bank_contours];
+      NormalMappedColorVertex* verts =
+          &bank_verts[(i - first) * num_bank_contours];
+      for (size_t j = 0; j < num_bank_contours; ++j) {
+        const bool left_bank = j <= river_idx;
+        // The texture is stretched from the side of the river to the far end
+        // of the bank. There are two banks, however, separated by the river.
+        // We need to know the width of the bank to caluate the `texture_u`
+        // coordinate.
+        const size_t bank_start = left_bank ? 0 : num_bank_contours - 1;
+        const size_t bank_end = left_bank ? river_idx : river_idx + 1;
+        const float bank_width = offsets[bank_start].x - offsets[bank_end].x;
+        const float texture_u =
+            (offsets[j].x - offsets[bank_end].x) / bank_width;
 
-    bank_mesh->AddIndices(bank_indices_by_zone[zone].data(),
-                          static_cast<int>(bank_indices_by_zone[zone].size()),
-                          bank_material);
-    if (!river_data->banks[zone]) {
-      // Now we make a new entity to hold the bank mesh.
-      river_data->banks[zone] = entity_manager_->AllocateNewEntity();
-      entity_manager_->AddEntityToComponent<RenderMeshComponent>(
-          river_data->banks[zone]);
-
-      // Then we stick it as a child of the river entity, so it always moves
-      // with it and stays aligned:
-      auto transform_component =
-          GetComponent<corgi::component_library::TransformComponent>();
-      transform_component->AddChild(river_data->banks[zone], entity);
-    }
-
-    RenderMeshData* child_render_data =
-        Data<RenderMeshData>(river_data->banks[zone]);
-    if (bank_material->textures().size() == 1) {
-      child_render_data->shaders.push_back(
-          asset_manager->LoadShader("shaders/textured_lit"));
-    } else {
-      child_render_data->shaders.push_back(
-          asset_manager->LoadShader("shaders/bank"));
+        verts[j].pos = row[j];
+        verts[j].tc = vec2_packed(vec2(texture_u, texture_v));
+        unsigned char color_bytes[4] = {255, 255, 255, zone_colors[i]};
+        memcpy(verts[j].color, color_bytes, sizeof(color_bytes));
+      }
     }
-    if (child_render_data->mesh != nullptr) {
-      // Mesh's destructor handles cleaning up its GL buffers
-      delete child_render_data->mesh;
-      child_render_data->mesh = nullptr;
+    // Computing the normals from the whole river's positions means they
+    // match up across the seams between chunks.
+    ComputeBankNormalsTangents(positions.data(), segment_count,
+                               num_bank_contours, river_idx, input.wraps,
+                               first, last - first + 1, bank_verts.data());
+
+    // The river has two of the middle vertices of the bank.
+    // The texture coordinates are different, however.
+    chunk.river_verts.resize(2 * (last - first + 1));
+    for (size_t i = first; i <= last; i++) {
+      const vec3_packed* row = &positions[i * num_bank_contours];
+      const float normalized_texture_v = i / static_cast<float>(segment_count);
+      for (size_t side = 0; side < 2; ++side) {
+        NormalMappedVertex& vert = chunk.river_verts[2 * (i - first) + side];
+        vert.pos = row[river_idx + side];
+        vert.tc = vec2(static_cast<float>(side), normalized_texture_v);
+        vert.norm = vec3_packed(vec3(0, 1, 0));
+        vert.tangent = vec4_packed(vec4(1, 0, 0, 1));
+      }
     }
-    child_render_data->mesh = bank_mesh;
-    child_render_data->culling_mask = 0;  // Don't cull the banks for now.
-    child_render_data->pass_mask = 1 << corgi::RenderPass_Opaque;
-    std::ostringstream debug_name;
-    debug_name << "river bank" << zone + 1;
-    child_render_data->debug_name = debug_name.str();
+
+    // Bound the chunk, and make its vertices relative to its center.
+    vec3 min_position = vec3(bank_verts[0].pos);
+    vec3 max_position = min_position;
+    for (auto v = bank_verts.begin(); v != bank_verts.end(); ++v) {
+      min_position = vec3::Min(min_position, vec3(v->pos));
+      max_position = vec3::Max(max_position, vec3(v->pos));
+    }
+    const vec3 center = (min_position + max_position) * 0.5f;
+    for (auto v = bank_verts.begin(); v != bank_verts.end(); ++v) {
+      v->pos = vec3(v->pos) - center;
+    }
+    for (auto v = chunk.river_verts.begin(); v != chunk.river_verts.end();
+         ++v) {
+      v->pos = vec3(v->pos) - center;
+    }
+    chunk.center = center;
+    chunk.radius = (max_position - min_position).Length() * 0.5f;
+
+    // River only has one quad per segment. The banks are split up by zone,
+    // so we can use different materials (and possibly shaders) per zone.
+    chunk.river_indices.clear();
+    chunk.bank_indices_by_zone.assign(num_zones,
+                                      std::vector<unsigned short>());
+    for (size_t i = first; i < last; ++i) {
+      make_quad(chunk.river_indices, 2 * (i - first), 0, 2);
+      for (size_t j = 0; j <= num_bank_quads; ++j) {
+        if (j == river_idx) continue;
+        make_quad(chunk.bank_indices_by_zone[bank_zones[i]],
+                  (i - first) * num_bank_contours, j, num_bank_contours + j);
+      }
+    }
+  }
+
+#if ZOOSHI_BENCHMARK_RIVER_NORMALS
+  BenchmarkBankNormals(positions, *geometry, num_bank_contours, river_idx,
+                       chunk_segments, input.wraps);
+#endif  // ZOOSHI_BENCHMARK_RIVER_NORMALS
+}
+
+// Reads values out of a mapped cache file, failing instead of reading past
+// the end of it.
+class RiverCacheReader {
+ public:
+  RiverCacheReader(const uint8_t* data, size_t size)
+      : data_(data), remaining_(size) {}
+
+  bool Read(void* out, size_t size) {
+    if (size > remaining_) return false;
+    if (size > 0) memcpy(out, data_, size);
+    data_ += size;
+    remaining_ -= size;
+    return true;
+  }
+
+  template <class T>
+  bool Read(T* value) {
+    return Read(value, sizeof(T));
+  }
+
+  template <class T>
+  bool ReadVector(std::vector<T>* values, uint32_t count) {
+    if (count > remaining_ / sizeof(T)) return false;
+    values->resize(count);
+    return Read(values->data(), count * sizeof(T));
+  }
+
+ private:
+  const uint8_t* data_;
+  size_t remaining_;
+};
+
+// Load the whole river from its cache file, if the file was generated from
+// the same input. Returns false if the river needs to be generated instead.
+static bool LoadRiverCache(const RiverBuildInput& input,
+                           RiverGeometry* geometry) {
+  MappedFile file;
+  if (!file.Open(input.cache_filename.c_str())) return false;
+  RiverCacheReader reader(file.data(), file.size());
+
+  const uint32_t num_chunks = static_cast<uint32_t>(
+      NumChunks(input.track.size(), input.chunk_segments));
+  const uint32_t num_zones = input.river->zones()->Length();
+  RiverCacheHeader header;
+  if (!reader.Read(&header) || header.magic != kRiverCacheMagic ||
+      header.version != kRiverCacheVersion || header.hash != input.hash ||
+      header.num_chunks != num_chunks || header.num_zones != num_zones) {
+    return false;
+  }
+
+  geometry->chunks.resize(num_chunks);
+  std::vector<uint32_t> counts(4 + num_zones);
+  for (uint32_t c = 0; c < num_chunks; ++c) {
+    RiverChunkGeometry& chunk = geometry->chunks[c];
+    vec3_packed center;
+    bool ok = reader.Read(&center) && reader.Read(&chunk.radius) &&
+              reader.Read(counts.data(), counts.size() * sizeof(uint32_t)) &&
+              reader.ReadVector(&chunk.river_verts, counts[0]) &&
+              reader.ReadVector(&chunk.river_indices, counts[1]) &&
+              reader.ReadVector(&chunk.bank_verts, counts[2]) &&
+              reader.ReadVector(&chunk.collision_triangles, counts[3]);
+    chunk.center = vec3(center);
+    chunk.bank_indices_by_zone.resize(num_zones);
+    for (uint32_t zone = 0; ok && zone < num_zones; ++zone) {
+      ok = reader.ReadVector(&chunk.bank_indices_by_zone[zone],
+                             counts[4 + zone]);
+    }
+    if (!ok) {
+      fplbase::LogError("RiverComponent: Cache %s is truncated.",
+                        input.cache_filename.c_str());
+      geometry->chunks.clear();
+      return false;
+    }
+  }
+  geometry->dirty_chunks.assign(num_chunks, true);
+
+  // Put the bank positions back together from the chunks, which share their
+  // first and last rows.
+  const size_t num_bank_contours = input.river->default_banks()->Length();
+  std::vector<vec3_packed>& positions = geometry->bank_positions;
+  positions.resize(input.track.size() * num_bank_contours);
+  for (uint32_t c = 0; c < num_chunks; ++c) {
+    const RiverChunkGeometry& chunk = geometry->chunks[c];
+    const size_t first = c * input.chunk_segments * num_bank_contours;
+    if (first + chunk.bank_verts.size() > positions.size()) {
+      fplbase::LogError("RiverComponent: Cache %s doesn't match its river.",
+                        input.cache_filename.c_str());
+      geometry->chunks.clear();
+      return false;
+    }
+    for (size_t v = 0; v < chunk.bank_verts.size(); ++v) {
+      positions[first + v] = vec3(chunk.bank_verts[v].pos) + chunk.center;
+    }
+  }
+  return true;
+}
+
+// Save the whole river to its cache file. It's written to a temporary file
+// first, so that a partly written cache is never loaded.
+static void SaveRiverCache(const RiverBuildInput& input,
+                           const RiverGeometry& geometry) {
+  const std::string temp_filename = input.cache_filename + ".tmp";
+  FILE* file = fopen(temp_filename.c_str(), "wb");
+  if (file == nullptr) {
+    fplbase::LogError("RiverComponent: Couldn't write %s",
+                      temp_filename.c_str());
+    return;
+  }
+  bool ok = true;
+  auto write = [file, &ok](const void* data, size_t size) {
+    if (ok && size > 0) ok = fwrite(data, size, 1, file) == 1;
+  };
+
+  const uint32_t num_zones = input.river->zones()->Length();
+  RiverCacheHeader header;
+  header.magic = kRiverCacheMagic;
+  header.version = kRiverCacheVersion;
+  header.hash = input.hash;
+  header.num_chunks = static_cast<uint32_t>(geometry.chunks.size());
+  header.num_zones = num_zones;
+  write(&header, sizeof(header));
+
+  std::vector<uint32_t> counts(4 + num_zones);
+  for (auto chunk = geometry.chunks.begin(); chunk != geometry.chunks.end();
+       ++chunk) {
+    const vec3_packed center(chunk->center);
+    counts[0] = static_cast<uint32_t>(chunk->river_verts.size());
+    counts[1] = static_cast<uint32_t>(chunk->river_indices.size());
+    counts[2] = static_cast<uint32_t>(chunk->bank_verts.size());
+    counts[3] = static_cast<uint32_t>(chunk->collision_triangles.size());
+    for (uint32_t zone = 0; zone < num_zones; ++zone) {
+      counts[4 + zone] =
+          static_cast<uint32_t>(chunk->bank_indices_by_zone[zone].size());
+    }
+    write(&center, sizeof(center));
+    write(&chunk->radius, sizeof(chunk->radius));
+    write(counts.data(), counts.size() * sizeof(uint32_t));
+    write(chunk->river_verts.data(),
+          chunk->river_verts.size() * sizeof(NormalMappedVertex));
+    write(chunk->river_indices.data(),
+          chunk->river_indices.size() * sizeof(unsigned short));
+    write(chunk->bank_verts.data(),
+          chunk->bank_verts.size() * sizeof(NormalMappedColorVertex));
+    write(chunk->collision_triangles.data(),
+          chunk->collision_triangles.size() * sizeof(vec3_packed));
+    for (uint32_t zone = 0; zone < num_zones; ++zone) {
+      const std::vector<unsigned short>& indices =
+          chunk->bank_indices_by_zone[zone];
+      write(indices.data(), indices.size() * sizeof(unsigned short));
+    }
+  }
+  ok = fclose(file) == 0 && ok;
+
+  // rename() won't replace an existing file on every platform.
+  remove(input.cache_filename.c_str());
+  if (!ok || rename(temp_filename.c_str(), input.cache_filename.c_str()) != 0) {
+    fplbase::LogError("RiverComponent: Couldn't write %s",
+                      input.cache_filename.c_str());
+    remove(temp_filename.c_str());
   }
+}
+
+// Creates the meshes of each dirty chunk of a generated river. Creating a
+// Mesh uploads it, so this must be called on the render thread.
+static void UploadRiverGeometry(RiverBuild* build) {
+  static const fplbase::Attribute kMeshFormat[] = {
+      fplbase::kPosition3f, fplbase::kTexCoord2f, fplbase::kNormal3f,
+      fplbase::kTangent4f, fplbase::kEND};
+  static const fplbase::Attribute kBankMeshFormat[] = {
+      fplbase::kPosition3f, fplbase::kTexCoord2f, fplbase::kNormal3f,
+      fplbase::kTangent4f,  fplbase::kColor4ub,   fplbase::kEND};
+  const RiverBuildInput& input = build->input;
+  const RiverGeometry& geometry = build->geometry;
+  const size_t num_chunks = geometry.chunks.size();
+  build->river_meshes.assign(num_chunks, nullptr);
+  build->bank_meshes.assign(num_chunks, nullptr);
+
+  for (size_t c = 0; c < num_chunks; ++c) {
+    if (!geometry.dirty_chunks[c]) continue;
+    const RiverChunkGeometry& chunk_geometry = geometry.chunks[c];
+
+    // Create the actual mesh objects, and stuff all the data we just
+    // generated into them.
+    Mesh* river_mesh =
+        new Mesh(chunk_geometry.river_verts.data(),
+                 static_cast<int>(chunk_geometry.river_verts.size()),
+                 static_cast<int>(sizeof(NormalMappedVertex)), kMeshFormat);
+    river_mesh->AddIndices(
+        chunk_geometry.river_indices.data(),
+        static_cast<int>(chunk_geometry.river_indices.size()),
+        input.river_material);
+    build->river_meshes[c] = river_mesh;
+
+    // All of the zones share one set of bank vertices, with a submesh for
+    // each zone's material.
+    Mesh* bank_mesh =
+        new Mesh(chunk_geometry.bank_verts.data(),
+                 static_cast<int>(chunk_geometry.bank_verts.size()),
+                 sizeof(NormalMappedColorVertex), kBankMeshFormat);
+    for (size_t zone = 0; zone < input.bank_materials.size(); zone++) {
+      const std::vector<unsigned short>& zone_indices =
+          chunk_geometry.bank_indices_by_zone[zone];
+      // Skip zones that don't reach this chunk.
+      if (zone_indices.empty()) continue;
+      bank_mesh->AddIndices(zone_indices.data(),
+                            static_cast<int>(zone_indices.size()),
+                            input.bank_materials[zone]);
+    }
+    build->bank_meshes[c] = bank_mesh;
+  }
+}
+
+// Puts the uploaded river meshes in this entity's children, and builds its
+// static physics mesh. The meshes they replace are retired, since snapshots
+// the render thread may still draw refer to them.
+void RiverComponent::ApplyRiverGeometry(corgi::EntityRef& entity,
+                                        RiverBuild* build) {
+  const RiverConfig* river = build->input.river;
+  const RiverGeometry& geometry = build->geometry;
+  RiverData* river_data = Data<RiverData>(entity);
+  // The next build works out what it has changed from these.
+  river_data->built_bank_positions.swap(build->geometry.bank_positions);
+  ServicesComponent* services =
+      entity_manager_->GetComponent<ServicesComponent>();
+  fplbase::AssetManager* asset_manager = services->asset_manager();
+  WorldRenderer* world_renderer = services->world()->world_renderer;
 
-  // Finalize the static physics mesh created on the river bank.
+  auto* physics_component = entity_manager_->GetComponent<PhysicsComponent>();
   short collision_type = static_cast<short>(river->collision_type());
   short collides_with = 0;
   if (river->collides_with()) {
@@ -512,24 +1437,155 @@ void RiverComponent::CreateRiverMesh(corgi::EntityRef& entity) {
     }
   }
   std::string user_tag = river->user_tag() ? river->user_tag()->c_str() : "";
-  physics_component->FinalizeStaticMesh(entity, collision_type, collides_with,
-                                        river->mass(), river->restitution(),
-                                        user_tag);
 
-  // We don't want to keep the random number generator set to the same
-  // value every time we generate the river, so reset the seed back to time.
-  srand(static_cast<unsigned int>(time(nullptr)));
+  // The shaders are loaded with the rest of the asset manifest.
+  fplbase::Shader* river_shader =
+      asset_manager->FindShader(river->shader()->c_str());
+  fplbase::Shader* depth_shader =
+      asset_manager->FindShader("shaders/render_depth");
+  fplbase::Shader* bank_shader = asset_manager->FindShader("shaders/bank");
+
+  // The river entity doesn't draw anything itself. Its meshes are split into
+  // chunks along the track, each of which is small enough to use 16-bit
+  // indices, and is culled on its own.
+  Data<RenderMeshData>(entity)->pass_mask = 0;
+
+  const size_t num_chunks = geometry.chunks.size();
+  if (river_data->chunks.size() < num_chunks) {
+    river_data->chunks.resize(num_chunks);
+  }
+
+  // Hide any chunks left over from a longer river, so they can be reused.
+  for (size_t c = num_chunks; c < river_data->chunks.size(); ++c) {
+    RiverChunk& chunk = river_data->chunks[c];
+    chunk.in_use = false;
+    Data<RenderMeshData>(chunk.water)->pass_mask = 0;
+    Data<RenderMeshData>(chunk.bank)->pass_mask = 0;
+    physics_component->DisablePhysics(chunk.collision);
+  }
+
+  for (size_t c = 0; c < num_chunks; ++c) {
+    // Chunks that haven't changed keep their meshes.
+    if (!geometry.dirty_chunks[c]) continue;
+    const RiverChunkGeometry& chunk_geometry = geometry.chunks[c];
+    RiverChunk& chunk = river_data->chunks[c];
+    chunk.center = chunk_geometry.center;
+    chunk.radius = chunk_geometry.radius;
+    chunk.in_use = true;
+
+    InitChildMesh(chunk.water, entity);
+    Data<TransformData>(chunk.water)->position = chunk.center;
+    RenderMeshData* water_data = Data<RenderMeshData>(chunk.water);
+    water_data->shaders.clear();
+    water_data->shaders.push_back(river_shader);
+    water_data->shaders.push_back(depth_shader);
+    if (water_data->mesh != nullptr) {
+      world_renderer->RetireMesh(water_data->mesh);
+    }
+    water_data->mesh = build->river_meshes[c];
+    // Chunks are culled against their bounding spheres, in CullChunks.
+    water_data->culling_mask = 0;
+    water_data->pass_mask = 1 << corgi::RenderPass_Opaque;
+    water_data->visible = true;
+    water_data->debug_name = "river";
+
+    // The bank is a child of the water, so they share a position.
+    InitChildMesh(chunk.bank, chunk.water);
+    RenderMeshData* child_render_data = Data<RenderMeshData>(chunk.bank);
+    child_render_data->shaders.clear();
+    child_render_data->shaders.push_back(bank_shader);
+    if (child_render_data->mesh != nullptr) {
+      world_renderer->RetireMesh(child_render_data->mesh);
+    }
+    child_render_data->mesh = build->bank_meshes[c];
+    child_render_data->culling_mask = 0;
+    child_render_data->pass_mask = 1 << corgi::RenderPass_Opaque;
+    child_render_data->visible = true;
+    child_render_data->debug_name = "river bank";
+
+    // Build the static mesh around this stretch of the river banks. It's
+    // kept on its own child, which stays at the river's origin.
+    InitChild(chunk.collision, entity);
+    physics_component->InitStaticMesh(chunk.collision);
+    const std::vector<vec3_packed>& collision =
+        chunk_geometry.collision_triangles;
+    for (size_t i = 0; i + 2 < collision.size(); i += 3) {
+      physics_component->AddStaticMeshTriangle(
+          chunk.collision, vec3(collision[i]), vec3(collision[i + 1]),
+          vec3(collision[i + 2]));
+    }
+    physics_component->FinalizeStaticMesh(chunk.collision, collision_type,
+                                          collides_with, river->mass(),
+                                          river->restitution(), user_tag);
+  }
+}
+
+corgi::EntityRef& RiverComponent::InitChild(corgi::EntityRef& child,
+                                            corgi::EntityRef& parent) {
+  if (!child) {
+    child = entity_manager_->AllocateNewEntity();
+
+    // Then we stick it as a child of `parent`, so it always moves with it
+    // and stays aligned:
+    auto transform_component = GetComponent<TransformComponent>();
+    transform_component->AddChild(child, parent);
+  }
+  return child;
+}
+
+corgi::EntityRef& RiverComponent::InitChildMesh(corgi::EntityRef& child,
+                                                corgi::EntityRef& parent) {
+  if (!child) {
+    InitChild(child, parent);
+    entity_manager_->AddEntityToComponent<RenderMeshComponent>(child);
+  }
+  return child;
+}
+
+// Chunks are much larger than the props corgi's view angle culling is meant
+// for, so test each chunk's whole bounding sphere against the view's cone.
+void RiverComponent::CullChunks(const corgi::CameraInterface& camera) {
+  const ViewCone view_cone(camera);
+  for (auto iter = begin(); iter != end(); ++iter) {
+    RiverData* river_data = Data<RiverData>(iter->entity);
+    const TransformData* transform_data = Data<TransformData>(iter->entity);
+    if (transform_data == nullptr) continue;
+    for (auto chunk = river_data->chunks.begin();
+         chunk != river_data->chunks.end(); ++chunk) {
+      if (!chunk->in_use) continue;
+      const bool visible = view_cone.ContainsSphere(
+          transform_data->world_transform * chunk->center, chunk->radius);
+      SetChunkVisible(*chunk, visible);
+    }
+  }
+}
+
+void RiverComponent::SetChunkVisible(const RiverChunk& chunk, bool visible) {
+  Data<RenderMeshData>(chunk.water)->visible = visible;
+  Data<RenderMeshData>(chunk.bank)->visible = visible;
+}
+
+// The bank shader blends between two textures. Zones with a single texture
+// get a material that uses it for both, so that every zone can be drawn with
+// the bank shader, as submeshes of one mesh.
+Material* RiverComponent::BankMaterial(Material* material) {
+  if (material->textures().size() != 1) return material;
+  auto existing = bank_materials_.find(material);
+  if (existing != bank_materials_.end()) return existing->second.get();
+
+  Material* bank_material = new Material();
+  bank_material->textures().push_back(material->textures()[0]);
+  bank_material->textures().push_back(material->textures()[0]);
+  bank_material->set_blend_mode(material->blend_mode());
+  bank_materials_[material].reset(bank_material);
+  return bank_material;
 }
 
 void RiverComponent::UpdateRiverMeshes(corgi::EntityRef entity) {
   const RailNodeData* node_data =
       entity_manager_->GetComponentData<RailNodeData>(entity);
   if (node_data != nullptr) {
-    // For now, update all rivers. In the future only update rivers that
-    // have the same rail_name that just changed.
-    for (auto iter = begin(); iter != end(); ++iter) {
-      CreateRiverMesh(iter->entity);
-    }
+    TriggerRiverUpdate(node_data->rail_name);
   }
 }
 
@@ -15,10 +15,16 @@
 #ifndef FPL_ZOOSHI_COMPONENTS_RIVER_H
 #define FPL_ZOOSHI_COMPONENTS_RIVER_H
 
+#include <deque>
+#include <map>
+#include <memory>
 #include <string>
 #include <vector>
+#include "SDL_mutex.h"
+#include "SDL_thread.h"
 #include "components_generated.h"
 #include "corgi/component.h"
+#include "corgi_component_library/camera_interface.h"
 #include "fplbase/mesh.h"
 #include "mathfu/constants.h"
 #include "mathfu/glsl_mappings.h"
@@ -28,25 +34,54 @@
 namespace fpl {
 namespace zooshi {
 
+struct RiverBuild;
+
+// One piece of a river's meshes, covering a stretch of its track.
+struct RiverChunk {
+  RiverChunk() : radius(0.0f), in_use(false) {}
+  // Holds the water mesh, and is the parent of the bank mesh.
+  corgi::EntityRef water;
+  // Holds the bank mesh, which has one submesh per zone.
+  corgi::EntityRef bank;
+  // Holds the static physics mesh of this stretch of the banks.
+  corgi::EntityRef collision;
+  // Bounding sphere of the chunk, relative to the river entity.
+  mathfu::vec3 center;
+  float radius;
+  // Chunks left over from a longer river are kept hidden for reuse.
+  bool in_use;
+};
+
 // All the relevent data for rivers ends up tossed into other components.
 // (Mostly rendermesh at the moment.)  This will probably be less empty
 // once the river gets more animated.
 struct RiverData {
   RiverData()
       : render_mesh_needs_update_(false),
-        random_seed(static_cast<unsigned int>(rand())) {}
-  std::vector<corgi::EntityRef> banks;
+        random_seed(static_cast<unsigned int>(rand())),
+        built_chunk_segments(0) {}
+  std::vector<RiverChunk> chunks;
   std::string rail_name;
   // Flag for whether this river needs its meshes updated.
   bool render_mesh_needs_update_;
   // River generation has random elements, so we seed the random number
   // generator the same way every time we reload the river.
   unsigned int random_seed;
+  // What the river was last generated from: its rail's nodes, the number of
+  // track positions between each pair of them, the track, and the chunk
+  // size. Also where every bank vertex ended up. Only the chunks that depend
+  // on rail nodes that have moved since are regenerated.
+  std::vector<mathfu::vec3_packed> built_nodes;
+  std::vector<size_t> built_span_segments;
+  std::vector<mathfu::vec3_packed> built_track;
+  size_t built_chunk_segments;
+  std::vector<mathfu::vec3_packed> built_bank_positions;
 };
 
 class RiverComponent : public corgi::Component<RiverData> {
  public:
-  virtual ~RiverComponent() {}
+  RiverComponent();
+  virtual ~RiverComponent();
 
   virtual void AddFromRawData(corgi::EntityRef& entity, const void* raw_data);
   virtual RawDataUniquePtr ExportRawData(const corgi::EntityRef& entity) const;
@@ -54,20 +89,68 @@ class RiverComponent : public corgi::Component<RiverData> {
   virtual void Init();
   virtual void UpdateAllEntities(corgi::WorldTime /*delta_time*/);
 
+  // Regenerate the rivers that follow the rail `entity` is a node of.
   void UpdateRiverMeshes(corgi::EntityRef entity);
 
-  // Updates the meshes for the river.
+  // Updates the meshes for the river. Rivers are generated on a worker
+  // thread, and their meshes are uploaded by UploadRiverMeshes. This starts
+  // generating the rivers that have changed, and puts the uploaded meshes in
+  // place. Call it on the update thread, before the world renderer takes its
+  // snapshot. A river's first build is waited for, so a level never starts
+  // without its river, but its meshes still show up a frame or two later.
+  void UpdateRiverMeshes();
+
+  // Upload the meshes of the rivers that have finished generating.
   // !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
   // IMPORTANT:  This will break if called from any thread other than
   // the main render thread.  Do not call from the update thread!
-  void UpdateRiverMeshes();
+  void UploadRiverMeshes();
+
+  // Hide the river chunks that are outside the camera's view.
+  void CullChunks(const corgi::CameraInterface& camera);
 
   float river_offset() const { return river_offset_; }
 
  private:
   void TriggerRiverUpdate();
-  void CreateRiverMesh(corgi::EntityRef& entity);
+  void TriggerRiverUpdate(const std::string& rail_name);
+  void OnEntityUpdated(corgi::EntityRef entity);
+  bool IsBuilding(const corgi::EntityRef& entity) const;
+  void StartRiverBuild(corgi::EntityRef& entity);
+  // Queue `build` for the worker thread, starting the thread if needed.
+  void QueueRiverBuild(RiverBuild* build);
+  // Block until the worker thread has finished `build`.
+  void WaitForRiverBuild(RiverBuild* build);
+  static int BuildThreadMain(void* data);
+  void RunRiverBuilds();
+  void ApplyRiverGeometry(corgi::EntityRef& entity, RiverBuild* build);
+  // Get a child entity of `parent`, allocating it if `child` is not valid
+  // yet.
+  corgi::EntityRef& InitChild(corgi::EntityRef& child,
+                              corgi::EntityRef& parent);
+  // Like InitChild, but the child also has a render mesh.
+  corgi::EntityRef& InitChildMesh(corgi::EntityRef& child,
+                                  corgi::EntityRef& parent);
+  void SetChunkVisible(const RiverChunk& chunk, bool visible);
+  fplbase::Material* BankMaterial(fplbase::Material* material);
   float river_offset_;
+  // Two-texture copies of single-texture bank materials, keyed by the
+  // original material.
+  std::map<fplbase::Material*, std::unique_ptr<fplbase::Material>>
+      bank_materials_;
+  // Rivers currently being generated.
+  std::vector<std::unique_ptr<RiverBuild>> builds_;
+  // One worker thread generates the builds in `build_queue_` in order, and
+  // moves them to `upload_queue_` for the render thread. Both queues,
+  // `quit_build_thread_` and each build's `finished` and `uploaded` flags
+  // are guarded by `build_mutex_`. `build_cond_` is signalled when a build
+  // is queued or finished, and when the thread should quit.
+  SDL_Thread* build_thread_;
+  SDL_mutex* build_mutex_;
+  SDL_cond* build_cond_;
+  std::deque<RiverBuild*> build_queue_;
+  std::vector<RiverBuild*> upload_queue_;
+  bool quit_build_thread_;
 };
 
 }  // zooshi
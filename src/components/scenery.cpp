@@ -72,36 +72,39 @@ corgi::ComponentInterface::RawDataUniquePtr SceneryComponent::ExportRawData(
 void SceneryComponent::InitEntity(corgi::EntityRef& /*scenery*/) {}
 
 void SceneryComponent::PostLoadFixup() {
-  const TransformComponent* transform_component =
-      entity_manager_->GetComponent<TransformComponent>();
-
   // Initialize each scenery.
   for (auto iter = component_data_.begin(); iter != component_data_.end();
        ++iter) {
-    corgi::EntityRef scenery = iter->entity;
-
-    // Get reference to the first child with a rendermesh. We assume there will
-    // only be one such child.
-    SceneryData* scenery_data = Data<SceneryData>(scenery);
-    scenery_data->render_child = transform_component->ChildWithComponent(
-        scenery, RenderMeshComponent::GetComponentId());
-    assert(scenery_data->render_child);
-
-    // Add animation to the entity with the rendermesh.
-    entity_manager_->AddEntityToComponent<AnimationComponent>(
-        scenery_data->render_child);
-    AnimationData* animation_data =
-        Data<AnimationData>(scenery_data->render_child);
-    animation_data->anim_table_object = scenery_data->anim_object;
-
-    // Everything starts off-screen.
-    scenery_data->state = kSceneryHide;
-
-    // Ensure all scenery starts hidden.
-    Show(scenery, false);
+    EntityPostLoadFixup(iter->entity);
   }
 }
 
+void SceneryComponent::EntityPostLoadFixup(const corgi::EntityRef& scenery) {
+  const TransformComponent* transform_component =
+      entity_manager_->GetComponent<TransformComponent>();
+
+  // Get reference to the first child with a rendermesh. We assume there will
+  // only be one such child.
+  SceneryData* scenery_data = Data<SceneryData>(scenery);
+  scenery_data->render_child = transform_component->ChildWithComponent(
+      scenery, RenderMeshComponent::GetComponentId());
+  assert(scenery_data->render_child);
+
+  // Add animation to the entity with the rendermesh.
+  entity_manager_->AddEntityToComponent<AnimationComponent>(
+      scenery_data->render_child);
+  AnimationData* animation_data =
+      Data<AnimationData>(scenery_data->render_child);
+  animation_data->anim_table_object = scenery_data->anim_object;
+
+  // Everything starts off-screen.
+  scenery_data->state = kSceneryHide;
+  scenery_data->still = false;
+
+  // Ensure all scenery starts hidden.
+  Show(scenery, false);
+}
+
 const RailDenizenData& SceneryComponent::Raft() const {
   const corgi::EntityRef raft =
       entity_manager_->GetComponent<ServicesComponent>()->raft_entity();
@@ -227,7 +230,9 @@ void SceneryComponent::ShowAll(bool show) {
 void SceneryComponent::AnimateScenery(const corgi::EntityRef& scenery,
                                       SceneryData* scenery_data,
                                       SceneryState state) {
-  if (HasAnim(scenery_data, state)) {
+  // Hidden scenery can't be seen, so don't spend time evaluating its
+  // skeleton. Appearing starts a new animation.
+  if (state != kSceneryHide && HasAnim(scenery_data, state)) {
     Animate(scenery, state);
   } else {
     StopAnimating(scenery);
@@ -347,12 +352,21 @@ void SceneryComponent::UpdateMovement(const corgi::EntityRef& scenery) {
   }
 }
 
+bool SceneryComponent::IsStill(const SceneryData* scenery_data) const {
+  const AnimationData* anim_data =
+      Data<AnimationData>(scenery_data->render_child);
+  return scenery_data->state == kSceneryShow &&
+         !scenery_data->delta_face_angle.Valid() &&
+         (anim_data == nullptr || !anim_data->motivator.Valid());
+}
+
 void SceneryComponent::UpdateAllEntities(corgi::WorldTime /*delta_time*/) {
   const RailDenizenData& raft = Raft();
+  bool still_changed = false;
   for (auto iter = component_data_.begin(); iter != component_data_.end();
        ++iter) {
     corgi::EntityRef scenery = iter->entity;
-    const SceneryData* scenery_data = Data<SceneryData>(scenery);
+    SceneryData* scenery_data = Data<SceneryData>(scenery);
 
     UpdateMovement(scenery);
 
@@ -365,6 +379,19 @@ void SceneryComponent::UpdateAllEntities(corgi::WorldTime /*delta_time*/) {
     if (scenery_data->state != next_state) {
       TransitionState(scenery, next_state);
     }
+
+    const bool still = IsStill(scenery_data);
+    if (scenery_data->still != still) {
+      scenery_data->still = still;
+      still_changed = true;
+    }
+  }
+
+  // Scenery that has settled, or started moving, has to be added to or
+  // taken out of the static shadow layer.
+  if (still_changed) {
+    World* world = entity_manager_->GetComponent<ServicesComponent>()->world();
+    world->world_renderer->InvalidateStaticShadows();
   }
 }
 
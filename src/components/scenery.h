@@ -44,7 +44,8 @@ struct SceneryData {
   SceneryData()
     : state(kSceneryHide),
       move_state(kSceneryMoveStateStatic),
-      show_override(kSceneryInvalid) {}
+      show_override(kSceneryInvalid),
+      still(false) {}
 
   // The child of the scenery entity that has a RenderMeshComponent and
   // an AnimationComponent.
@@ -69,6 +70,10 @@ struct SceneryData {
   // the show state. The scenery override is reset when the scenery object
   // disappears.
   SceneryState show_override;
+
+  // True while the scenery is fully shown and neither animating nor turning,
+  // so the world renderer can draw its shadow into the static shadow layer.
+  bool still;
 };
 
 class SceneryComponent : public corgi::Component<SceneryData> {
@@ -84,6 +89,8 @@ class SceneryComponent : public corgi::Component<SceneryData> {
 
   // This needs to be called after the entities have been loaded from data.
   void PostLoadFixup();
+  // As PostLoadFixup, for one scenery entity created after the level loaded.
+  void EntityPostLoadFixup(const corgi::EntityRef& scenery);
 
   // Apply an override animation to an entity that only applies in the `Show`
   // state.
@@ -113,6 +120,7 @@ class SceneryComponent : public corgi::Component<SceneryData> {
                                     bool visible);
   void FaceRaft(const corgi::EntityRef& scenery);
   void UpdateMovement(const corgi::EntityRef& scenery);
+  bool IsStill(const SceneryData* scenery_data) const;
 
   const Config* config_;
 };
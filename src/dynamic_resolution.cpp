@@ -0,0 +1,145 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "dynamic_resolution.h"
+
+#include <algorithm>
+#include "config_generated.h"
+#include "fplbase/glplatform.h"
+#include "fplbase/mesh.h"
+#include "fplbase/utilities.h"
+
+using mathfu::vec2;
+using mathfu::vec2i;
+using mathfu::vec3;
+using mathfu::mat4;
+
+namespace fpl {
+namespace zooshi {
+
+// The frame time the scale is chosen to fit, in milliseconds.
+static const float kTargetFrameTime = 1000.0f / 60.0f;
+
+// Frames are only counted as over budget once they're clearly past a vsync,
+// so that small amounts of jitter don't drop the resolution.
+static const float kOverBudgetFrameTime = kTargetFrameTime * 1.2f;
+
+// How quickly the smoothed frame time follows the measured one.
+static const float kFrameTimeSmoothing = 0.1f;
+
+// Change in scale each time it's adjusted.
+static const float kScaleStep = 0.05f;
+
+// The scale drops quickly when frames are late, but only rises again once
+// they've been on time for a while, so it doesn't bounce between two steps.
+static const int kFramesBetweenDecreases = 15;
+static const int kFramesBeforeIncrease = 180;
+
+DynamicResolution::DynamicResolution()
+    : target_size_(0, 0),
+      scene_size_(0, 0),
+      min_scale_(1.0f),
+      max_scale_(1.0f),
+      scale_(1.0f),
+      average_frame_time_(kTargetFrameTime),
+      frames_since_change_(0),
+      frames_within_budget_(0),
+      active_(false) {}
+
+void DynamicResolution::Initialize(const RenderConfig* config) {
+  max_scale_ = mathfu::Clamp(config->dynamic_resolution_max_scale(), 0.1f,
+                             1.0f);
+  min_scale_ = mathfu::Clamp(config->dynamic_resolution_min_scale(), 0.1f,
+                             max_scale_);
+  scale_ = max_scale_;
+  average_frame_time_ = kTargetFrameTime;
+  frames_since_change_ = 0;
+  frames_within_budget_ = 0;
+}
+
+void DynamicResolution::AddFrameTime(int frame_time) {
+  if (min_scale_ >= max_scale_) return;
+
+  average_frame_time_ +=
+      (static_cast<float>(frame_time) - average_frame_time_) *
+      kFrameTimeSmoothing;
+  ++frames_since_change_;
+  if (average_frame_time_ > kOverBudgetFrameTime) {
+    frames_within_budget_ = 0;
+    if (frames_since_change_ >= kFramesBetweenDecreases) {
+      SetScale(scale_ - kScaleStep);
+    }
+  } else if (++frames_within_budget_ >= kFramesBeforeIncrease) {
+    frames_within_budget_ = 0;
+    SetScale(scale_ + kScaleStep);
+  }
+}
+
+void DynamicResolution::SetScale(float scale) {
+  scale = mathfu::Clamp(scale, min_scale_, max_scale_);
+  if (scale == scale_) return;
+  scale_ = scale;
+  frames_since_change_ = 0;
+}
+
+void DynamicResolution::BeginScene(fplbase::Renderer& renderer) {
+  active_ = scale_ < 1.0f;
+  if (!active_) return;
+
+  // The target is big enough for the largest scale, so changing the scale
+  // only changes how much of it is used.
+  const vec2i window_size = renderer.window_size();
+  const vec2i target_size(
+      std::max(1, static_cast<int>(window_size.x * max_scale_)),
+      std::max(1, static_cast<int>(window_size.y * max_scale_)));
+  if (target_size != target_size_) {
+    if (target_size_.x > 0) target_.Delete();
+    target_.Initialize(target_size);
+    target_size_ = target_size;
+  }
+  scene_size_ = vec2i(
+      std::max(1, static_cast<int>(window_size.x * scale_)),
+      std::max(1, static_cast<int>(window_size.y * scale_)));
+
+  target_.SetAsRenderTarget();
+  renderer.ClearFrameBuffer(mathfu::kZeros4f);
+  glViewport(0, 0, scene_size_.x, scene_size_.y);
+}
+
+void DynamicResolution::EndScene(fplbase::Renderer& renderer,
+                                 fplbase::Shader* shader) {
+  if (!active_) return;
+  active_ = false;
+
+  fplbase::RenderTarget::ScreenRenderTarget(renderer).SetAsRenderTarget();
+  const vec2 window_size = vec2(renderer.window_size());
+  renderer.set_model_view_projection(
+      mat4::Ortho(0.0f, window_size.x, window_size.y, 0.0f, -1.0f, 1.0f));
+  renderer.set_color(mathfu::kOnes4f);
+  renderer.SetBlendMode(fplbase::kBlendModeOff);
+  renderer.SetDepthFunction(fplbase::kDepthFunctionDisabled);
+  target_.BindAsTexture(0);
+  shader->Set(renderer);
+
+  // Render targets have their origin at the bottom left, and the scene only
+  // covers part of the target.
+  const vec2 scene_extent = vec2(scene_size_) / vec2(target_size_);
+  fplbase::Mesh::RenderAAQuadAlongX(vec3(0.0f, window_size.y, 0.0f),
+                                    vec3(window_size.x, 0.0f, 0.0f),
+                                    vec2(0.0f, 0.0f), scene_extent);
+  renderer.SetDepthFunction(fplbase::kDepthFunctionLess);
+}
+
+}  // zooshi
+}  // fpl
@@ -0,0 +1,75 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ZOOSHI_DYNAMIC_RESOLUTION_H_
+#define ZOOSHI_DYNAMIC_RESOLUTION_H_
+
+#include "fplbase/render_target.h"
+#include "fplbase/renderer.h"
+#include "fplbase/shader.h"
+#include "mathfu/glsl_mappings.h"
+
+namespace fpl {
+namespace zooshi {
+
+struct RenderConfig;
+
+// Renders the world into an offscreen target at a fraction of the window's
+// resolution, and stretches it back over the window. The fraction is picked
+// from recent frame times, so that slow devices trade resolution for a
+// steady frame rate.
+class DynamicResolution {
+ public:
+  DynamicResolution();
+
+  // Read the range of scales from `config`.
+  void Initialize(const RenderConfig* config);
+
+  // Account for a frame that took `frame_time` milliseconds to render.
+  void AddFrameTime(int frame_time);
+
+  // Start rendering the world. Until EndScene, rendering goes to the
+  // offscreen target, or straight to the screen when the scale is 1.
+  void BeginScene(fplbase::Renderer& renderer);
+
+  // Stretch the world over the screen with `shader`, which should draw a
+  // plain texture.
+  void EndScene(fplbase::Renderer& renderer, fplbase::Shader* shader);
+
+  // Fraction of the window's width and height the world is rendered at.
+  float scale() const { return scale_; }
+
+ private:
+  void SetScale(float scale);
+
+  fplbase::RenderTarget target_;
+  // Size of `target_`, which is the window's size at the largest scale.
+  mathfu::vec2i target_size_;
+  // Size the world is being rendered at, in the corner of `target_`.
+  mathfu::vec2i scene_size_;
+  float min_scale_;
+  float max_scale_;
+  float scale_;
+  // Smoothed frame time, in milliseconds.
+  float average_frame_time_;
+  int frames_since_change_;
+  int frames_within_budget_;
+  // Whether the current scene is being rendered to `target_`.
+  bool active_;
+};
+
+}  // zooshi
+}  // fpl
+
+#endif  // ZOOSHI_DYNAMIC_RESOLUTION_H_
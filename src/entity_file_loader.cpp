@@ -0,0 +1,94 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "entity_file_loader.h"
+
+#include <algorithm>
+#include "SDL_atomic.h"
+#include "SDL_cpuinfo.h"
+#include "SDL_thread.h"
+#include "components_generated.h"
+#include "flatbuffers/flatbuffers.h"
+#include "fplbase/utilities.h"
+
+namespace fpl {
+namespace zooshi {
+
+// Reading files is mostly waiting on storage, so there's little to gain from
+// more threads than this.
+static const int kMaxReaderThreads = 4;
+
+// Shared by the threads reading one list of files. Each thread takes the
+// next file that nobody has started on, until there are none left.
+struct EntityFileReaders {
+  std::vector<std::unique_ptr<EntityFile>>* files;
+  SDL_atomic_t next_file;
+};
+
+bool EntityFile::Load() {
+  valid_ = false;
+  loaded_.clear();
+  if (!mapped_.Open(filename_.c_str()) &&
+      !fplbase::LoadFile(filename_.c_str(), &loaded_)) {
+    fplbase::LogError("Couldn't load entity file %s", filename_.c_str());
+    return false;
+  }
+  flatbuffers::Verifier verifier(data(), size());
+  valid_ = VerifyEntityListDefBuffer(verifier);
+  if (!valid_) {
+    fplbase::LogError("Entity file %s is corrupt", filename_.c_str());
+  }
+  return valid_;
+}
+
+static int ReadEntityFilesThread(void* data) {
+  EntityFileReaders* readers = static_cast<EntityFileReaders*>(data);
+  const int num_files = static_cast<int>(readers->files->size());
+  for (;;) {
+    const int i = SDL_AtomicAdd(&readers->next_file, 1);
+    if (i >= num_files) break;
+    (*readers->files)[i]->Load();
+  }
+  return 0;
+}
+
+void ReadEntityFiles(std::vector<std::unique_ptr<EntityFile>>* files) {
+  EntityFileReaders readers;
+  readers.files = files;
+  SDL_AtomicSet(&readers.next_file, 0);
+
+  // The calling thread reads files too, rather than sitting idle.
+  const int num_threads =
+      std::min(std::min(SDL_GetCPUCount(), kMaxReaderThreads),
+               static_cast<int>(files->size())) - 1;
+  std::vector<SDL_Thread*> threads;
+  for (int i = 0; i < num_threads; ++i) {
+    SDL_Thread* thread = SDL_CreateThread(ReadEntityFilesThread,
+                                          "Zooshi Entity Reader", &readers);
+    if (thread == nullptr) {
+      fplbase::LogError("Couldn't create entity reader thread: %s",
+                        SDL_GetError());
+      break;
+    }
+    threads.push_back(thread);
+  }
+  ReadEntityFilesThread(&readers);
+  for (auto thread = threads.begin(); thread != threads.end(); ++thread) {
+    SDL_WaitThread(*thread, nullptr);
+  }
+}
+
+}  // zooshi
+}  // fpl
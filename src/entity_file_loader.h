@@ -0,0 +1,71 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef ZOOSHI_ENTITY_FILE_LOADER_H_
+#define ZOOSHI_ENTITY_FILE_LOADER_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "mapped_file.h"
+
+namespace fpl {
+namespace zooshi {
+
+// An entity file, as read by ReadEntityFiles.
+class EntityFile {
+ public:
+  explicit EntityFile(const std::string& filename)
+      : filename_(filename), valid_(false) {}
+
+  // Map the file, or read it if it can't be mapped, as with Android assets.
+  // Returns false if the file couldn't be loaded, or isn't a valid
+  // EntityListDef flatbuffer.
+  bool Load();
+
+  const std::string& filename() const { return filename_; }
+  bool valid() const { return valid_; }
+
+  // The whole file. Stays valid until the EntityFile is destroyed, so
+  // components can keep pointers into it.
+  const uint8_t* data() const {
+    return mapped_.is_open()
+               ? mapped_.data()
+               : reinterpret_cast<const uint8_t*>(loaded_.c_str());
+  }
+  size_t size() const {
+    return mapped_.is_open() ? mapped_.size() : loaded_.size();
+  }
+
+ private:
+  EntityFile(const EntityFile&);
+  EntityFile& operator=(const EntityFile&);
+
+  std::string filename_;
+  MappedFile mapped_;
+  // Only used when the file couldn't be mapped.
+  std::string loaded_;
+  bool valid_;
+};
+
+// Load each of `files` on worker threads, and wait for them all to finish.
+// Only the files' data is touched, so the entities can then be created from
+// them on the calling thread in whatever order it needs.
+void ReadEntityFiles(std::vector<std::unique_ptr<EntityFile>>* files);
+
+}  // zooshi
+}  // fpl
+
+#endif  // ZOOSHI_ENTITY_FILE_LOADER_H_
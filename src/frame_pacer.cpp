@@ -0,0 +1,123 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "frame_pacer.h"
+
+#include "SDL_timer.h"
+#include "fplbase/utilities.h"
+
+namespace fpl {
+namespace zooshi {
+
+// SDL_Delay can oversleep by about a scheduler tick, so the pacer stops
+// sleeping this long before each deadline, and spins for the rest.
+static const Uint32 kSpinMilliseconds = 2;
+
+// Rates outside of this range are treated as the nearest end of it.
+static const float kMinRefreshRate = 1.0f;
+static const float kMaxRefreshRate = 1000.0f;
+
+FramePacer::FramePacer()
+    : thread_(nullptr),
+      callback_(nullptr),
+      period_(0),
+      total_error_(0.0),
+      max_error_(0.0),
+      num_frames_(0),
+      skipped_frames_(0) {
+  SDL_AtomicSet(&running_, 0);
+}
+
+FramePacer::~FramePacer() { Stop(); }
+
+void FramePacer::Start(float refresh_rate, Callback callback) {
+  Stop();
+  refresh_rate = refresh_rate < kMinRefreshRate
+                     ? kMinRefreshRate
+                     : (refresh_rate > kMaxRefreshRate ? kMaxRefreshRate
+                                                       : refresh_rate);
+  period_ = static_cast<Uint64>(
+      static_cast<double>(SDL_GetPerformanceFrequency()) / refresh_rate);
+  callback_ = callback;
+  total_error_ = 0.0;
+  max_error_ = 0.0;
+  num_frames_ = 0;
+  skipped_frames_ = 0;
+
+  SDL_AtomicSet(&running_, 1);
+  thread_ = SDL_CreateThread(ThreadMain, "Zooshi Frame Pacer", this);
+  if (thread_ == nullptr) {
+    fplbase::LogError("FramePacer: Couldn't create thread: %s",
+                      SDL_GetError());
+    SDL_AtomicSet(&running_, 0);
+  }
+}
+
+void FramePacer::Stop() {
+  if (thread_ == nullptr) return;
+  SDL_AtomicSet(&running_, 0);
+  SDL_WaitThread(thread_, nullptr);
+  thread_ = nullptr;
+  fplbase::LogInfo(
+      "FramePacer: %d frames, %.3fms late on average, %.3fms at worst, %d "
+      "skipped",
+      num_frames_, average_error(), max_error_, skipped_frames_);
+}
+
+double FramePacer::average_error() const {
+  return num_frames_ > 0 ? total_error_ / num_frames_ : 0.0;
+}
+
+int FramePacer::ThreadMain(void* data) {
+  static_cast<FramePacer*>(data)->Run();
+  return 0;
+}
+
+void FramePacer::Run() {
+  const Uint64 frequency = SDL_GetPerformanceFrequency();
+  const double ticks_to_ms = 1000.0 / static_cast<double>(frequency);
+  const Uint64 spin_ticks = frequency * kSpinMilliseconds / 1000;
+  Uint64 deadline = SDL_GetPerformanceCounter() + period_;
+
+  while (SDL_AtomicGet(&running_)) {
+    // Sleep through most of the frame, then spin until the deadline.
+    Uint64 now = SDL_GetPerformanceCounter();
+    if (now + spin_ticks < deadline) {
+      SDL_Delay(static_cast<Uint32>((deadline - now - spin_ticks) *
+                                    ticks_to_ms));
+    }
+    do {
+      now = SDL_GetPerformanceCounter();
+    } while (now < deadline);
+
+    callback_();
+
+    const double error = static_cast<double>(now - deadline) * ticks_to_ms;
+    total_error_ += error;
+    if (error > max_error_) max_error_ = error;
+    ++num_frames_;
+
+    // Deadlines stay on a fixed grid, so small delays don't accumulate. If
+    // the thread fell more than a frame behind, start again from now rather
+    // than calling back several times in a row to catch up.
+    deadline += period_;
+    if (now >= deadline) {
+      skipped_frames_ += static_cast<int>((now - deadline) / period_) + 1;
+      deadline = now + period_;
+    }
+  }
+}
+
+}  // zooshi
+}  // fpl
@@ -0,0 +1,72 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ZOOSHI_FRAME_PACER_H_
+#define ZOOSHI_FRAME_PACER_H_
+
+#include "SDL_atomic.h"
+#include "SDL_stdinc.h"
+#include "SDL_thread.h"
+
+namespace fpl {
+namespace zooshi {
+
+// Stands in for vsync events on platforms that don't report them, by calling
+// a function at a fixed rate from its own thread. It sleeps for most of each
+// frame, and only spins for the last moment before the deadline.
+class FramePacer {
+ public:
+  typedef void (*Callback)();
+
+  FramePacer();
+  ~FramePacer();
+
+  // Start calling `callback` `refresh_rate` times a second.
+  void Start(float refresh_rate, Callback callback);
+
+  // Stop calling the callback, wait for the thread to finish, and log how
+  // closely the frames were paced.
+  void Stop();
+
+  // How late, on average and at worst, the callback was called, in
+  // milliseconds.
+  double average_error() const;
+  double max_error() const { return max_error_; }
+  // Number of deadlines that were missed by more than a whole frame, and
+  // skipped.
+  int skipped_frames() const { return skipped_frames_; }
+
+ private:
+  FramePacer(const FramePacer&);
+  FramePacer& operator=(const FramePacer&);
+
+  static int ThreadMain(void* data);
+  void Run();
+
+  SDL_Thread* thread_;
+  SDL_atomic_t running_;
+  Callback callback_;
+  // Length of a frame, in performance counter ticks.
+  Uint64 period_;
+  // Statistics, only written by the pacer's thread while it's running.
+  double total_error_;
+  double max_error_;
+  int num_frames_;
+  int skipped_frames_;
+};
+
+}  // zooshi
+}  // fpl
+
+#endif  // ZOOSHI_FRAME_PACER_H_
@@ -612,10 +612,11 @@ static int UpdateThread(void *data) {
     SDL_CondWait(sync.start_update_cv_, sync.updatethread_mutex_);
 
     // -------------------------------------------
-    // Step 5b.  (See comment at the start of Run()
-    // Update everything.  This is only called once everything has been
-    // safely loaded up into openGL and the renderthread is working its way
-    // through actually putting everything on the screen.
+    // Step 4b.  (See comment at the start of Run()
+    // Update everything.  This is only called once the renderthread has
+    // read its input and picked up the last snapshot, and is working its way
+    // through drawing it. It waits for the update to finish before it draws
+    // the UI.
     // -------------------------------------------
     SDL_LockMutex(sync.gameupdate_mutex_);
     const corgi::WorldTime world_time = CurrentWorldTime(*rt_data->input);
@@ -651,15 +652,6 @@ void HandleVsync() {
   SDL_CondBroadcast(global_vsync_context->start_render_cv_);
 }
 
-// Hack, to simulate vsync events on non-android devices.
-static int VsyncSimulatorThread(void * /*data*/) {
-  while (true) {
-    HandleVsync();
-    SDL_Delay(2);
-  }
-  return 0;
-}
-
 // For performance, we're using multiple threads so that the game state can
 // be updating in the background while openGL renders.
 // The general plan is:
@@ -717,12 +709,9 @@ void Game::Run() {
   fplbase::RegisterVsyncCallback(HandleVsync);
 #else
   // We don't need this on android because we'll just get vsync events directly.
-  SDL_Thread *vsync_simulator_thread = SDL_CreateThread(
-      VsyncSimulatorThread, "Zooshi Simulated Vsync Thread", nullptr);
-  if (!vsync_simulator_thread) {
-    LogError("Error creating vsync simulator thread.");
-    assert(false);
-  }
+  // Elsewhere, simulate them at the display's usual refresh rate.
+  frame_pacer_.Start(GetConfig().rendering_config()->frame_pacer_refresh_rate(),
+                     HandleVsync);
 #endif  // __ANDROID__
   int last_frame_id = 0;
 
@@ -780,9 +769,22 @@ void Game::Run() {
     // Milliseconds elapsed since last update.
     rt_data.frame_start = CurrentWorldTimeSubFrame(input_);
 
+    // The state can change while the world is drawn, so pick it now.
+    StateNode *render_state = state_machine_.current_state();
+    SDL_UnlockMutex(sync_.gameupdate_mutex_);
+
     // -------------------------------------------
     // Step 3.
-    // Render everything.
+    // Signal the update thread that it is safe to start messing with
+    // data. States draw the world only from the snapshot the last update
+    // took, so the next update can run while they do.
+    // -------------------------------------------
+    SDL_CondBroadcast(sync_.start_update_cv_);
+
+    // -------------------------------------------
+    // Step 4a.
+    // Render the world, then wait for the update to finish before drawing
+    // the UI, which reads the game's state directly.
     // -------------------------------------------
     SystraceBegin("StateMachine::Render()");
 
@@ -792,28 +794,25 @@ void Game::Run() {
     renderer_.SetCulling(fplbase::kCullingModeBack);
     PopDebugMarker();
 
-    state_machine_.Render(&renderer_);
+    if (render_state != nullptr) {
+      render_state->Render(&renderer_);
+    }
     SystraceEnd();
 
-    SDL_UnlockMutex(sync_.gameupdate_mutex_);
+    SDL_LockMutex(sync_.gameupdate_mutex_);
+    world_renderer_.RenderDebugPhysics(renderer_, &world_);
 
     SystraceBegin("StateMachine::HandleUI()");
     state_machine_.HandleUI(&renderer_);
     SystraceEnd();
+    SDL_UnlockMutex(sync_.gameupdate_mutex_);
 
     // -------------------------------------------
-    // Step 4.
-    // Signal the update thread that it is safe to start messing with
-    // data, now that we've already handed it all off to openGL.
-    // -------------------------------------------
-    SDL_CondBroadcast(sync_.start_update_cv_);
-
-    // -------------------------------------------
-    // Step 5a.
+    // Step 5.
     // Start openGL actually rendering.  AdvanceFrame will (among other things)
     // trigger a gl_flush.  This thread will block until it is completed,
-    // but that's ok because the update thread is humming in the background
-    // preparing the world state for next frame.
+    // but that's ok because the update thread has already prepared the
+    // world state for next frame while the world was being drawn.
     // -------------------------------------------
     SystraceBegin("AdvanceFrame");
     renderer_.AdvanceFrame(input_.minimized(), input_.Time());
@@ -831,6 +830,11 @@ void Game::Run() {
 
     int new_time = CurrentWorldTimeSubFrame(input_);
     int frame_time = new_time - rt_data.frame_start;
+    // Cardboard views are always drawn at full resolution, so their frame
+    // times would only skew the scale picked for the next monoscopic frame.
+    if (!world_renderer_.snapshot().stereoscopic) {
+      world_renderer_.dynamic_resolution().AddFrameTime(frame_time);
+    }
 #if DISPLAY_FRAMERATE_HISTOGRAM
     UpdateProfiling(frame_time);
 #endif  // DISPLAY_FRAMERATE_HISTOGRAM
@@ -841,6 +845,8 @@ void Game::Run() {
 // Clean up asynchronous callbacks to prevent crashing on garbage data.
 #ifdef __ANDROID__
   fplbase::RegisterVsyncCallback(nullptr);
+#else
+  frame_pacer_.Stop();
 #endif  // __ANDROID__
   input_.AddAppEventCallback(nullptr);
 }
@@ -25,6 +25,7 @@
 #include "corgi/entity_manager.h"
 #include "flatbuffers/flatbuffers.h"
 #include "flatui/font_manager.h"
+#include "frame_pacer.h"
 #include "fplbase/asset_manager.h"
 #include "fplbase/input.h"
 #include "fplbase/renderer.h"
@@ -220,6 +221,11 @@ class Game {
 
   // The XP system, used to grant rewards after playing.
   XpSystem xp_system_;
+
+#ifndef __ANDROID__
+  // Simulates vsync events, which are only reported on Android.
+  FramePacer frame_pacer_;
+#endif  // __ANDROID__
 };
 
 }  // zooshi
@@ -0,0 +1,420 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "level_streamer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "components/rail_denizen.h"
+#include "corgi_component_library/rendermesh.h"
+#include "corgi_component_library/transform.h"
+#include "fplbase/utilities.h"
+#include "world.h"
+
+using mathfu::mat4;
+using mathfu::vec3;
+
+namespace fpl {
+namespace zooshi {
+
+using corgi::component_library::RenderMeshData;
+using corgi::component_library::TransformData;
+
+// The TransformDef in the entity's own components, or null if it has none.
+static const corgi::TransformDef* GetTransformDef(const EntityDef* entity_def) {
+  const corgi::TransformDef* transform_def = nullptr;
+  auto component_list = entity_def->component_list();
+  for (auto instance = component_list->begin();
+       instance != component_list->end(); ++instance) {
+    if (instance->data_type() == ComponentDataUnion_corgi_TransformDef) {
+      transform_def = static_cast<const corgi::TransformDef*>(instance->data());
+    }
+  }
+  return transform_def;
+}
+
+// The name of the prototype `entity_def` is based on, or null if it has none.
+static const char* GetPrototypeName(const EntityDef* entity_def) {
+  const char* prototype_name = nullptr;
+  auto component_list = entity_def->component_list();
+  for (auto instance = component_list->begin();
+       instance != component_list->end(); ++instance) {
+    if (instance->data_type() != ComponentDataUnion_corgi_MetaDef) continue;
+    auto meta_def = static_cast<const corgi::MetaDef*>(instance->data());
+    if (meta_def->prototype() != nullptr) {
+      prototype_name = meta_def->prototype()->c_str();
+    }
+  }
+  return prototype_name;
+}
+
+// The largest scale `world_transform` applies along any of its axes.
+static float MaxScale(const mat4& world_transform) {
+  float scale = 0.0f;
+  for (int i = 0; i < 3; ++i) {
+    scale = std::max(scale, world_transform.GetColumn(i).xyz().Length());
+  }
+  return scale;
+}
+
+// Grow `radius` to reach around `origin` to the far side of every mesh at or
+// under `entity`. Meshes without bounds are skipped.
+static void GrowMeshRadius(World* world, corgi::EntityRef entity,
+                           const vec3& origin, float* radius) {
+  const RenderMeshData* rendermesh_data =
+      world->entity_manager.GetComponentData<RenderMeshData>(entity);
+  if (rendermesh_data != nullptr && rendermesh_data->mesh != nullptr) {
+    const vec3 min_position = rendermesh_data->mesh->min_position();
+    const vec3 max_position = rendermesh_data->mesh->max_position();
+    const float mesh_radius = (max_position - min_position).Length() * 0.5f;
+    if (mesh_radius > 0.0f) {
+      const mat4 world_transform =
+          world->transform_component.WorldTransform(entity);
+      const vec3 center =
+          world_transform * ((min_position + max_position) * 0.5f);
+      *radius = std::max(*radius, (center - origin).Length() +
+                                      mesh_radius * MaxScale(world_transform));
+    }
+  }
+  const TransformData* transform_data =
+      world->entity_manager.GetComponentData<TransformData>(entity);
+  if (transform_data != nullptr) {
+    for (auto iter = transform_data->children.begin();
+         iter != transform_data->children.end(); ++iter) {
+      GrowMeshRadius(world, iter->owner, origin, radius);
+    }
+  }
+}
+
+// Delete `entity` and everything under it.
+static void DeleteRecursively(World* world, corgi::EntityRef entity) {
+  const TransformData* transform_data =
+      world->entity_manager.GetComponentData<TransformData>(entity);
+  if (transform_data != nullptr) {
+    for (auto iter = transform_data->children.begin();
+         iter != transform_data->children.end(); ++iter) {
+      DeleteRecursively(world, iter->owner);
+    }
+  }
+  world->entity_manager.DeleteEntity(entity);
+}
+
+void LevelStreamer::Reset(const LevelStreamingConfig* config) {
+  config_ = config != nullptr && config->section_length() > 0.0f ? config
+                                                                 : nullptr;
+  entities_.clear();
+  section_offsets_.clear();
+  section_loaded_.clear();
+  wanted_sections_.clear();
+  wanted_.clear();
+  current_section_ = kNoSection;
+  wraps_ = false;
+  loaded_all_ = false;
+  prototype_radii_.clear();
+}
+
+bool LevelStreamer::AddEntity(World* world, const EntityDef* entity_def,
+                              const char* source_file) {
+  if (config_ == nullptr || !section_offsets_.empty() || loaded_all_) {
+    return false;
+  }
+
+  // Only scenery is streamed. It doesn't move, and nothing else refers to it.
+  const corgi::TransformDef* transform_def = GetTransformDef(entity_def);
+  if (transform_def == nullptr || transform_def->position() == nullptr ||
+      !world->prototype_cache.HasComponent(entity_def,
+                                           ComponentDataUnion_SceneryDef) ||
+      world->prototype_cache.HasComponent(entity_def,
+                                          ComponentDataUnion_RailDenizenDef)) {
+    return false;
+  }
+
+  StreamedEntity streamed;
+  streamed.entity_def = entity_def;
+  streamed.source_file = source_file;
+  streamed.position = mathfu::vec3_packed(vec3(transform_def->position()->x(),
+                                               transform_def->position()->y(),
+                                               transform_def->position()->z()));
+  streamed.distance = 0.0f;
+  entities_.push_back(streamed);
+  return true;
+}
+
+void LevelStreamer::Partition(World* world) {
+  if (config_ == nullptr) return;
+
+  // Resuming after LoadAll, every prop was created, so the ones that are
+  // gone were deleted on purpose.
+  if (loaded_all_) {
+    entities_.erase(
+        std::remove_if(entities_.begin(), entities_.end(),
+                       [](const StreamedEntity& streamed) {
+                         return !streamed.entity.IsValid();
+                       }),
+        entities_.end());
+    loaded_all_ = false;
+  }
+  if (entities_.empty()) return;
+
+  const RailDenizenData* raft_data =
+      world->entity_manager.GetComponentData<RailDenizenData>(
+          world->services_component.raft_entity());
+  if (raft_data == nullptr || raft_data->rail == nullptr ||
+      raft_data->rail->Length() <= 0.0f) {
+    LoadAll(world);
+    return;
+  }
+
+  // Find how far along the rail each prop is, in the rail's own space, as
+  // RailVisibility does. Props that already exist may have been moved.
+  const Rail& rail = *raft_data->rail;
+  const vec3& scale = raft_data->rail_scale;
+  for (auto streamed = entities_.begin(); streamed != entities_.end();
+       ++streamed) {
+    const TransformData* transform_data =
+        streamed->entity.IsValid()
+            ? world->entity_manager.GetComponentData<TransformData>(
+                  streamed->entity)
+            : nullptr;
+    if (transform_data != nullptr) {
+      streamed->position = mathfu::vec3_packed(transform_data->position);
+    }
+    const vec3 rail_position =
+        raft_data->rail_orientation *
+        ((vec3(streamed->position) - raft_data->rail_offset) / scale);
+    streamed->distance =
+        rail.DistanceAtTime(rail.ClosestTime(rail_position, nullptr));
+  }
+  std::stable_sort(entities_.begin(), entities_.end(),
+                   [](const StreamedEntity& a, const StreamedEntity& b) {
+                     return a.distance < b.distance;
+                   });
+
+  const float section_length = config_->section_length();
+  const int num_sections =
+      std::max(1, static_cast<int>(ceilf(rail.Length() / section_length)));
+  section_offsets_.assign(num_sections + 1, 0);
+  for (auto streamed = entities_.begin(); streamed != entities_.end();
+       ++streamed) {
+    const int section =
+        std::min(static_cast<int>(streamed->distance / section_length),
+                 num_sections - 1);
+    ++section_offsets_[section + 1];
+  }
+  for (int section = 0; section < num_sections; ++section) {
+    section_offsets_[section + 1] += section_offsets_[section];
+  }
+  // The props of a section are created in order, so move any that already
+  // exist to the front of their section.
+  section_loaded_.assign(num_sections, 0);
+  for (int section = 0; section < num_sections; ++section) {
+    auto section_begin = entities_.begin() + section_offsets_[section];
+    auto loaded_end = std::stable_partition(
+        section_begin, entities_.begin() + section_offsets_[section + 1],
+        [](const StreamedEntity& streamed) {
+          return streamed.entity.IsValid();
+        });
+    section_loaded_[section] =
+        static_cast<uint32_t>(loaded_end - section_begin);
+  }
+  wraps_ = rail.wraps();
+
+  fplbase::LogInfo("LevelStreamer: %d props in %d sections",
+                   static_cast<int>(entities_.size()), num_sections);
+
+  // The props around the start are all there before the first frame.
+  current_section_ = kNoSection;
+  Update(world);
+  CreateWanted(world, std::numeric_limits<int>::max());
+}
+
+void LevelStreamer::Update(World* world) {
+  if (config_ == nullptr || section_offsets_.empty()) return;
+
+  const RailDenizenData* raft_data =
+      world->entity_manager.GetComponentData<RailDenizenData>(
+          world->services_component.raft_entity());
+  if (raft_data == nullptr || raft_data->rail == nullptr) return;
+
+  const Rail& rail = *raft_data->rail;
+  const int num_sections = static_cast<int>(section_loaded_.size());
+  const float distance =
+      rail.DistanceAtTime(raft_data->lap_progress * rail.EndTime());
+  const int section = std::max(
+      0, std::min(static_cast<int>(distance / config_->section_length()),
+                  num_sections - 1));
+  if (section != current_section_) {
+    current_section_ = section;
+    ChooseSections(section);
+    bool unloaded = false;
+    for (int i = 0; i < num_sections; ++i) {
+      if (!wanted_[i] && section_loaded_[i] > 0) {
+        UnloadSection(world, i);
+        unloaded = true;
+      }
+    }
+    // Still scenery is drawn into the static shadow layer, so the deleted
+    // props may still be in it. Props being created start hidden, and
+    // SceneryComponent invalidates the layer once they settle.
+    if (unloaded) world->world_renderer->InvalidateStaticShadows();
+  }
+  CreateWanted(world, std::max(config_->entities_per_frame(), 1));
+}
+
+void LevelStreamer::LoadAll(World* world) {
+  if (config_ == nullptr || loaded_all_) return;
+  for (auto streamed = entities_.begin(); streamed != entities_.end();
+       ++streamed) {
+    if (!streamed->entity.IsValid()) CreateEntity(world, &*streamed);
+  }
+  section_offsets_.clear();
+  section_loaded_.clear();
+  wanted_sections_.clear();
+  wanted_.clear();
+  current_section_ = kNoSection;
+  loaded_all_ = true;
+  world->world_renderer->InvalidateStaticShadows();
+}
+
+bool LevelStreamer::PropBounds(World* world, size_t index, vec3* center,
+                               float* radius) {
+  StreamedEntity* streamed = &entities_[index];
+  const char* prototype_name = GetPrototypeName(streamed->entity_def);
+  auto cached = prototype_name != nullptr
+                    ? prototype_radii_.find(prototype_name)
+                    : prototype_radii_.end();
+  float prototype_radius = 0.0f;
+  if (cached != prototype_radii_.end()) {
+    prototype_radius = cached->second;
+  } else {
+    const bool loaded = streamed->entity.IsValid();
+    if (!loaded) CreateEntity(world, streamed);
+    const mat4 world_transform =
+        world->transform_component.WorldTransform(streamed->entity);
+    GrowMeshRadius(world, streamed->entity,
+                   world_transform.TranslationVector3D(), &prototype_radius);
+    const float scale = MaxScale(world_transform);
+    prototype_radius = scale > 0.0f ? prototype_radius / scale : 0.0f;
+    if (!loaded) DeleteEntity(world, streamed);
+    if (prototype_name != nullptr) {
+      prototype_radii_[prototype_name] = prototype_radius;
+    }
+  }
+  if (prototype_radius <= 0.0f) return false;
+
+  // Props that are loaded may have been scaled since they were.
+  float scale = 1.0f;
+  if (streamed->entity.IsValid()) {
+    scale = MaxScale(
+        world->transform_component.WorldTransform(streamed->entity));
+  } else {
+    const corgi::TransformDef* transform_def =
+        GetTransformDef(streamed->entity_def);
+    if (transform_def->scale() != nullptr) {
+      scale = std::max(std::max(fabsf(transform_def->scale()->x()),
+                                fabsf(transform_def->scale()->y())),
+                       fabsf(transform_def->scale()->z()));
+    }
+  }
+  *center = vec3(streamed->position);
+  *radius = prototype_radius * scale;
+  return true;
+}
+
+void LevelStreamer::ChooseSections(int section) {
+  const int num_sections = static_cast<int>(section_loaded_.size());
+  const int max_entities = config_->max_entities() > 0
+                               ? config_->max_entities()
+                               : std::numeric_limits<int>::max();
+  wanted_.assign(num_sections, 0);
+  wanted_sections_.clear();
+  int num_entities = 0;
+
+  // Returns false once the budget is used up.
+  auto want = [&](int wanted_section) {
+    if (wraps_) {
+      wanted_section = (wanted_section % num_sections + num_sections) %
+                       num_sections;
+    } else if (wanted_section < 0 || wanted_section >= num_sections) {
+      return true;
+    }
+    if (wanted_[wanted_section]) return true;
+    const int size = static_cast<int>(section_offsets_[wanted_section + 1] -
+                                      section_offsets_[wanted_section]);
+    // The raft's own section is always loaded.
+    if (!wanted_sections_.empty() && num_entities + size > max_entities) {
+      return false;
+    }
+    num_entities += size;
+    wanted_[wanted_section] = 1;
+    wanted_sections_.push_back(wanted_section);
+    return true;
+  };
+
+  want(section);
+  const int reach =
+      std::max(config_->sections_ahead(), config_->sections_behind());
+  for (int i = 1; i <= reach; ++i) {
+    if (i <= config_->sections_ahead() && !want(section + i)) break;
+    if (i <= config_->sections_behind() && !want(section - i)) break;
+  }
+}
+
+void LevelStreamer::CreateEntity(World* world, StreamedEntity* streamed) {
+  corgi::EntityRef entity = world->prototype_cache.CreateEntity(
+      streamed->entity_def, &world->entity_manager);
+  world->meta_component.AddEntity(entity)->source_file = streamed->source_file;
+  // The level's post-load fixups have already run, so run them for this
+  // entity alone.
+  world->transform_component.UpdateChildLinks(entity);
+  world->scenery_component.EntityPostLoadFixup(entity);
+  world->graph_component.EntityPostLoadFixup(entity);
+  streamed->entity = entity;
+  world->rail_visibility.AttachProp(world, streamed - &entities_[0], entity);
+}
+
+void LevelStreamer::DeleteEntity(World* world, StreamedEntity* streamed) {
+  world->rail_visibility.DetachProp(streamed - &entities_[0]);
+  if (streamed->entity.IsValid()) DeleteRecursively(world, streamed->entity);
+  streamed->entity = corgi::EntityRef();
+}
+
+void LevelStreamer::UnloadSection(World* world, int section) {
+  const uint32_t begin = section_offsets_[section];
+  for (uint32_t i = begin; i < begin + section_loaded_[section]; ++i) {
+    DeleteEntity(world, &entities_[i]);
+  }
+  section_loaded_[section] = 0;
+}
+
+void LevelStreamer::CreateWanted(World* world, int max_entities) {
+  int num_created = 0;
+  for (auto section = wanted_sections_.begin();
+       section != wanted_sections_.end() && num_created < max_entities;
+       ++section) {
+    const uint32_t begin = section_offsets_[*section];
+    const uint32_t end = section_offsets_[*section + 1];
+    uint32_t& loaded = section_loaded_[*section];
+    while (begin + loaded < end && num_created < max_entities) {
+      CreateEntity(world, &entities_[begin + loaded]);
+      ++loaded;
+      ++num_created;
+    }
+  }
+}
+
+}  // zooshi
+}  // fpl
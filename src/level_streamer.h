@@ -0,0 +1,146 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef ZOOSHI_LEVEL_STREAMER_H_
+#define ZOOSHI_LEVEL_STREAMER_H_
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "components_generated.h"
+#include "config_generated.h"
+#include "corgi/entity_manager.h"
+#include "mathfu/glsl_mappings.h"
+
+namespace fpl {
+namespace zooshi {
+
+struct World;
+
+// Keeps only the scenery props near the raft loaded. The props are split
+// into sections along the raft's rail, by the point on the rail closest to
+// each one. As the raft moves, the sections ahead of it are created a few
+// props a frame, and the sections it has left behind are deleted, along with
+// their children and physics bodies.
+class LevelStreamer {
+ public:
+  LevelStreamer()
+      : config_(nullptr),
+        current_section_(kNoSection),
+        wraps_(false),
+        loaded_all_(false) {}
+
+  // Forget every prop, and stream the props added from now on as `config`
+  // says. Streaming is off if `config` is null. Doesn't delete any entities.
+  void Reset(const LevelStreamingConfig* config);
+
+  // Take over creating the entity defined by `entity_def`, loaded from
+  // `source_file`, if it's a scenery prop that can be streamed. Returns
+  // false if the caller should create it instead.
+  bool AddEntity(World* world, const EntityDef* entity_def,
+                 const char* source_file);
+
+  // Sort the props added since Reset into sections along the raft's rail,
+  // and create the ones near the raft. Must be called once the raft is on
+  // its rail. Props are all created at once if the raft has no rail.
+  // After LoadAll, resumes streaming, keeping the props that are still
+  // there.
+  void Partition(World* world);
+
+  // Create and delete props as the raft moves from section to section, and
+  // create a few more of the props still to be created.
+  void Update(World* world);
+
+  // Create every prop and stop streaming until the next Partition. Used when
+  // entering Scene Lab, which saves entities back to their files, and can
+  // move props out of their sections. Props deleted before streaming resumes
+  // are forgotten. Props streamed back in afterwards are created from the
+  // level's files as they were loaded, so edits to them are lost.
+  void LoadAll(World* world);
+
+  // Whether props are currently being created and deleted as the raft moves.
+  bool streaming() const {
+    return config_ != nullptr && !section_offsets_.empty();
+  }
+
+  // The props, by an index that stays the same until the next Partition.
+  size_t num_props() const { return entities_.size(); }
+  corgi::EntityRef prop_entity(size_t index) const {
+    return entities_[index].entity;
+  }
+
+  // Get a sphere holding every mesh of prop `index`, whether or not the prop
+  // is loaded. Props of the same prototype are assumed to be the same size,
+  // apart from their scale, so one of each is measured, and created to be
+  // measured if none are loaded. Returns false if the prop has no meshes
+  // with bounds.
+  bool PropBounds(World* world, size_t index, mathfu::vec3* center,
+                  float* radius);
+
+ private:
+  static const int kNoSection = -1;
+
+  struct StreamedEntity {
+    const EntityDef* entity_def;
+    const char* source_file;
+    // Where the prop is, and then how far along the rail it is.
+    mathfu::vec3_packed position;
+    float distance;
+    corgi::EntityRef entity;
+  };
+
+  // Choose the sections to keep around `section`, closest first.
+  void ChooseSections(int section);
+  void CreateEntity(World* world, StreamedEntity* streamed);
+  void DeleteEntity(World* world, StreamedEntity* streamed);
+  void UnloadSection(World* world, int section);
+  // Create up to `max_entities` props from the wanted sections.
+  void CreateWanted(World* world, int max_entities);
+
+  const LevelStreamingConfig* config_;
+
+  // Every prop, in section order. Section `i` holds the range
+  // [section_offsets_[i], section_offsets_[i + 1]).
+  std::vector<StreamedEntity> entities_;
+  std::vector<uint32_t> section_offsets_;
+
+  // Number of props created in each section. Props are created in order, so
+  // these are the first props of the section.
+  std::vector<uint32_t> section_loaded_;
+
+  // The sections to keep loaded, closest to the raft first, and whether each
+  // section is one of them.
+  std::vector<int> wanted_sections_;
+  std::vector<uint8_t> wanted_;
+
+  int current_section_;
+
+  // Whether the rail wraps around, so the sections past its end are the
+  // ones at its start.
+  bool wraps_;
+
+  // Whether LoadAll has created every prop since the last Partition.
+  bool loaded_all_;
+
+  // The radius around a prop's origin of its meshes, at a scale of one, by
+  // the name of the prop's prototype.
+  std::unordered_map<std::string, float> prototype_radii_;
+};
+
+}  // zooshi
+}  // fpl
+
+#endif  // ZOOSHI_LEVEL_STREAMER_H_
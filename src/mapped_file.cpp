@@ -0,0 +1,121 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif  // _WIN32
+
+namespace fpl {
+namespace zooshi {
+
+#ifdef _WIN32
+
+MappedFile::MappedFile()
+    : data_(nullptr),
+      size_(0),
+      is_open_(false),
+      file_(INVALID_HANDLE_VALUE),
+      mapping_(nullptr) {}
+
+bool MappedFile::Open(const char* filename) {
+  Close();
+  file_ = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr,
+                      OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file_ == INVALID_HANDLE_VALUE) return false;
+  LARGE_INTEGER file_size;
+  if (!GetFileSizeEx(file_, &file_size)) {
+    Close();
+    return false;
+  }
+  size_ = static_cast<size_t>(file_size.QuadPart);
+  is_open_ = true;
+  // Empty files can't be mapped, but there's nothing to read from them.
+  if (size_ == 0) return true;
+
+  mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (mapping_ != nullptr) {
+    data_ = static_cast<const uint8_t*>(
+        MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+  }
+  if (data_ == nullptr) {
+    Close();
+    return false;
+  }
+  return true;
+}
+
+void MappedFile::Close() {
+  if (data_ != nullptr) UnmapViewOfFile(data_);
+  if (mapping_ != nullptr) CloseHandle(mapping_);
+  if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+  data_ = nullptr;
+  size_ = 0;
+  is_open_ = false;
+  file_ = INVALID_HANDLE_VALUE;
+  mapping_ = nullptr;
+}
+
+#else
+
+MappedFile::MappedFile() : data_(nullptr), size_(0), is_open_(false) {}
+
+bool MappedFile::Open(const char* filename) {
+  Close();
+  const int fd = open(filename, O_RDONLY);
+  if (fd < 0) return false;
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0) {
+    close(fd);
+    return false;
+  }
+  size_ = static_cast<size_t>(file_stat.st_size);
+  is_open_ = true;
+  // Empty files can't be mapped, but there's nothing to read from them.
+  if (size_ > 0) {
+    void* mapped = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapped == MAP_FAILED) {
+      close(fd);
+      Close();
+      return false;
+    }
+    data_ = static_cast<const uint8_t*>(mapped);
+  }
+  // The mapping keeps the file's contents available after it's closed.
+  close(fd);
+  return true;
+}
+
+void MappedFile::Close() {
+  if (data_ != nullptr) {
+    munmap(const_cast<uint8_t*>(data_), size_);
+  }
+  data_ = nullptr;
+  size_ = 0;
+  is_open_ = false;
+}
+
+#endif  // _WIN32
+
+MappedFile::~MappedFile() { Close(); }
+
+}  // zooshi
+}  // fpl
@@ -0,0 +1,58 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ZOOSHI_MAPPED_FILE_H_
+#define ZOOSHI_MAPPED_FILE_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace fpl {
+namespace zooshi {
+
+// A read-only view of a whole file, mapped into memory rather than read, so
+// that only the pages that are actually touched are loaded from disk.
+class MappedFile {
+ public:
+  MappedFile();
+  ~MappedFile();
+
+  // Map `filename`, replacing any file already mapped. Returns false if the
+  // file doesn't exist or can't be mapped.
+  bool Open(const char* filename);
+
+  // Unmap the file. Pointers returned by data() are invalid afterwards.
+  void Close();
+
+  bool is_open() const { return is_open_; }
+  const uint8_t* data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  MappedFile(const MappedFile&);
+  MappedFile& operator=(const MappedFile&);
+
+  const uint8_t* data_;
+  size_t size_;
+  bool is_open_;
+#ifdef _WIN32
+  void* file_;
+  void* mapping_;
+#endif  // _WIN32
+};
+
+}  // zooshi
+}  // fpl
+
+#endif  // ZOOSHI_MAPPED_FILE_H_
@@ -0,0 +1,177 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "prototype_cache.h"
+
+#include "flatbuffers/flatbuffers.h"
+#include "fplbase/utilities.h"
+
+namespace fpl {
+namespace zooshi {
+
+// Prototypes based on prototypes this deep are assumed to be based on
+// themselves.
+static const int kMaxPrototypeDepth = 16;
+
+void PrototypeCache::SetComponentType(corgi::ComponentId component_id,
+                                      unsigned int data_type) {
+  if (data_type >= component_ids_.size()) {
+    component_ids_.resize(data_type + 1, corgi::kInvalidComponent);
+  }
+  component_ids_[data_type] = component_id;
+}
+
+void PrototypeCache::AddLibrary(const EntityListDef* library) {
+  for (auto entity_def = library->entity_list()->begin();
+       entity_def != library->entity_list()->end(); ++entity_def) {
+    auto component_list = entity_def->component_list();
+    for (auto instance = component_list->begin();
+         instance != component_list->end(); ++instance) {
+      if (instance->data_type() != ComponentDataUnion_corgi_MetaDef) continue;
+      auto meta_def = static_cast<const corgi::MetaDef*>(instance->data());
+      if (meta_def->entity_id() != nullptr) {
+        prototypes_[meta_def->entity_id()->str()] = *entity_def;
+      }
+    }
+  }
+  blueprints_.clear();
+}
+
+const PrototypeCache::Blueprint* PrototypeCache::GetBlueprint(
+    const char* prototype_name) {
+  auto cached = blueprints_.find(prototype_name);
+  if (cached != blueprints_.end()) return cached->second.get();
+
+  auto prototype = prototypes_.find(prototype_name);
+  if (prototype == prototypes_.end()) {
+    fplbase::LogError("PrototypeCache: No prototype named '%s'",
+                      prototype_name);
+    return nullptr;
+  }
+  if (depth_ >= kMaxPrototypeDepth) {
+    fplbase::LogError("PrototypeCache: Prototype '%s' is based on itself",
+                      prototype_name);
+    return nullptr;
+  }
+
+  std::unique_ptr<Blueprint> blueprint(new Blueprint());
+  ++depth_;
+  AppendComponents(prototype->second, true, &blueprint->components);
+  --depth_;
+
+  flatbuffers::FlatBufferBuilder builder;
+  auto name = builder.CreateString(prototype_name);
+  corgi::MetaDefBuilder meta_def(builder);
+  meta_def.add_prototype(name);
+  builder.Finish(meta_def.Finish());
+  blueprint->meta_def.assign(
+      builder.GetBufferPointer(),
+      builder.GetBufferPointer() + builder.GetSize());
+
+  const Blueprint* result = blueprint.get();
+  blueprints_[prototype_name] = std::move(blueprint);
+  return result;
+}
+
+void PrototypeCache::AppendComponents(
+    const EntityDef* entity_def, bool is_prototype,
+    std::vector<BlueprintComponent>* components) {
+  // The entity factory keeps the last definition of each type in an entity,
+  // and adds them in order of type, after everything from the prototype.
+  const void* definitions[ComponentDataUnion_MAX + 1] = {};
+  auto component_list = entity_def->component_list();
+  for (auto instance = component_list->begin();
+       instance != component_list->end(); ++instance) {
+    if (instance->data_type() <= ComponentDataUnion_MAX) {
+      definitions[instance->data_type()] = instance->data();
+    }
+  }
+
+  auto meta_def = static_cast<const corgi::MetaDef*>(
+      definitions[ComponentDataUnion_corgi_MetaDef]);
+  if (meta_def != nullptr && meta_def->prototype() != nullptr) {
+    const Blueprint* prototype = GetBlueprint(meta_def->prototype()->c_str());
+    if (prototype != nullptr) {
+      components->insert(components->end(), prototype->components.begin(),
+                         prototype->components.end());
+    }
+  }
+  if (is_prototype) definitions[ComponentDataUnion_corgi_MetaDef] = nullptr;
+
+  for (unsigned int data_type = 0; data_type < component_ids_.size();
+       ++data_type) {
+    if (definitions[data_type] == nullptr ||
+        component_ids_[data_type] == corgi::kInvalidComponent) {
+      continue;
+    }
+    BlueprintComponent component;
+    component.component_id = component_ids_[data_type];
+    component.data_type = data_type;
+    component.data = definitions[data_type];
+    components->push_back(component);
+  }
+}
+
+corgi::EntityRef PrototypeCache::CreateEntity(
+    const std::vector<BlueprintComponent>& components,
+    corgi::EntityManager* entity_manager) {
+  corgi::EntityRef entity = entity_manager->AllocateNewEntity();
+  for (auto component = components.begin(); component != components.end();
+       ++component) {
+    entity_manager->GetComponent(component->component_id)
+        ->AddFromRawData(entity, component->data);
+  }
+  return entity;
+}
+
+corgi::EntityRef PrototypeCache::CreateEntityFromPrototype(
+    const char* prototype_name, corgi::EntityManager* entity_manager) {
+  const Blueprint* blueprint = GetBlueprint(prototype_name);
+  if (blueprint == nullptr) return corgi::EntityRef();
+  corgi::EntityRef entity = CreateEntity(blueprint->components, entity_manager);
+  if (ComponentDataUnion_corgi_MetaDef < component_ids_.size() &&
+      component_ids_[ComponentDataUnion_corgi_MetaDef] !=
+          corgi::kInvalidComponent) {
+    const corgi::ComponentId meta_id =
+        component_ids_[ComponentDataUnion_corgi_MetaDef];
+    entity_manager->GetComponent(meta_id)->AddFromRawData(
+        entity, flatbuffers::GetRoot<corgi::MetaDef>(&blueprint->meta_def[0]));
+  }
+  return entity;
+}
+
+corgi::EntityRef PrototypeCache::CreateEntity(
+    const EntityDef* entity_def, corgi::EntityManager* entity_manager) {
+  // Only the prototype is flattened once. The entity's own components are
+  // gathered each time, as most entities that aren't prototypes are only
+  // created once.
+  std::vector<BlueprintComponent> components;
+  AppendComponents(entity_def, false, &components);
+  return CreateEntity(components, entity_manager);
+}
+
+bool PrototypeCache::HasComponent(const EntityDef* entity_def,
+                                  unsigned int data_type) {
+  std::vector<BlueprintComponent> components;
+  AppendComponents(entity_def, false, &components);
+  for (auto component = components.begin(); component != components.end();
+       ++component) {
+    if (component->data_type == data_type) return true;
+  }
+  return false;
+}
+
+}  // zooshi
+}  // fpl
@@ -0,0 +1,101 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef ZOOSHI_PROTOTYPE_CACHE_H_
+#define ZOOSHI_PROTOTYPE_CACHE_H_
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "components_generated.h"
+#include "corgi/entity_manager.h"
+
+namespace fpl {
+namespace zooshi {
+
+// Creates entities from prototypes without going back to the prototype
+// library each time. The first time a prototype is used, its chain of
+// prototypes is flattened into a blueprint: the list of components to add,
+// in the order the entity factory would add them, each with the definition
+// to add it from. Creating an entity from the prototype after that is just a
+// matter of adding those components.
+class PrototypeCache {
+ public:
+  PrototypeCache() : depth_(0) {}
+
+  // Record that components with definitions of type `data_type` are added
+  // to `component_id`.
+  void SetComponentType(corgi::ComponentId component_id,
+                        unsigned int data_type);
+
+  // Make the prototypes in `library` available, by their MetaDef entity_id.
+  // The library must stay loaded for as long as the cache is used.
+  void AddLibrary(const EntityListDef* library);
+
+  // Create an entity from the named prototype, as
+  // EntityFactory::CreateEntityFromPrototype would.
+  corgi::EntityRef CreateEntityFromPrototype(
+      const char* prototype_name, corgi::EntityManager* entity_manager);
+
+  // Create an entity from `entity_def`, which can be based on a prototype.
+  corgi::EntityRef CreateEntity(const EntityDef* entity_def,
+                                corgi::EntityManager* entity_manager);
+
+  // Whether entities created from `entity_def` get a definition of type
+  // `data_type`, from it or from its prototypes.
+  bool HasComponent(const EntityDef* entity_def, unsigned int data_type);
+
+ private:
+  // A component to add to new entities, and the definition to add it from.
+  struct BlueprintComponent {
+    corgi::ComponentId component_id;
+    unsigned int data_type;
+    const void* data;
+  };
+
+  struct Blueprint {
+    std::vector<BlueprintComponent> components;
+    // A MetaDef naming the prototype, which is added to entities created
+    // directly from it, as the entity factory does.
+    std::vector<uint8_t> meta_def;
+  };
+
+  // The blueprint for the named prototype, flattening it if it hasn't been
+  // used before. Returns null if there's no such prototype.
+  const Blueprint* GetBlueprint(const char* prototype_name);
+
+  // Append the components `entity_def` adds, including those from its
+  // prototypes, to `components`. Prototypes' own MetaDefs aren't inherited.
+  void AppendComponents(const EntityDef* entity_def, bool is_prototype,
+                        std::vector<BlueprintComponent>* components);
+
+  corgi::EntityRef CreateEntity(
+      const std::vector<BlueprintComponent>& components,
+      corgi::EntityManager* entity_manager);
+
+  // The component for each type of definition, by ComponentDataUnion value.
+  std::vector<corgi::ComponentId> component_ids_;
+  std::unordered_map<std::string, const EntityDef*> prototypes_;
+  std::unordered_map<std::string, std::unique_ptr<Blueprint>> blueprints_;
+  // How many prototypes are being flattened, to catch prototypes that are
+  // based on themselves.
+  int depth_;
+};
+
+}  // zooshi
+}  // fpl
+
+#endif  // ZOOSHI_PROTOTYPE_CACHE_H_
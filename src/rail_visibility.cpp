@@ -0,0 +1,337 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "rail_visibility.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "components/player.h"
+#include "components/player_projectile.h"
+#include "components/rail_denizen.h"
+#include "components/scenery.h"
+#include "components/simple_movement.h"
+#include "config_generated.h"
+#include "corgi_component_library/rendermesh.h"
+#include "corgi_component_library/transform.h"
+#include "fplbase/utilities.h"
+#include "world.h"
+
+using mathfu::vec3;
+using mathfu::mat4;
+
+namespace fpl {
+namespace zooshi {
+
+using corgi::component_library::RenderMeshData;
+using corgi::component_library::TransformData;
+
+const uint32_t RailVisibility::kNoProp;
+
+bool RailVisibility::IsStatic(World* world, corgi::EntityRef entity) {
+  corgi::EntityManager& entity_manager = world->entity_manager;
+  while (entity.IsValid()) {
+    if (entity_manager.GetComponentData<RailDenizenData>(entity) ||
+        entity_manager.GetComponentData<PlayerData>(entity) ||
+        entity_manager.GetComponentData<PlayerProjectileData>(entity) ||
+        entity_manager.GetComponentData<SimpleMovementData>(entity)) {
+      return false;
+    }
+    const TransformData* transform_data =
+        entity_manager.GetComponentData<TransformData>(entity);
+    if (transform_data == nullptr) break;
+    entity = transform_data->parent;
+  }
+  return true;
+}
+
+bool RailVisibility::IsScenery(World* world, corgi::EntityRef entity) {
+  corgi::EntityManager& entity_manager = world->entity_manager;
+  while (entity.IsValid()) {
+    if (entity_manager.GetComponentData<SceneryData>(entity)) return true;
+    const TransformData* transform_data =
+        entity_manager.GetComponentData<TransformData>(entity);
+    if (transform_data == nullptr) break;
+    entity = transform_data->parent;
+  }
+  return false;
+}
+
+void RailVisibility::Bake(World* world) {
+  Reset(world);
+  entities_.clear();
+  props_begin_ = 0;
+  prop_indices_.clear();
+  pass_masks_.clear();
+  prop_pass_masks_.clear();
+  hidden_.clear();
+  segment_offsets_.clear();
+  segment_entities_.clear();
+
+  const RenderConfig* render_config = world->config->rendering_config();
+  const int segment_count = render_config->pvs_segment_count();
+  if (segment_count <= 0) return;
+
+  const RailDenizenData* raft_data =
+      world->entity_manager.GetComponentData<RailDenizenData>(
+          world->services_component.raft_entity());
+  if (raft_data == nullptr || raft_data->rail == nullptr) return;
+
+  const Rail& rail = *raft_data->rail;
+  const float end_time = rail.EndTime();
+  if (rail.num_samples() == 0 || end_time <= 0.0f) return;
+
+  // Gather the static entities, with a bounding sphere for each.
+  std::vector<vec3> centers;
+  std::vector<float> radii;
+  for (auto iter = world->render_mesh_component.begin();
+       iter != world->render_mesh_component.end(); ++iter) {
+    const RenderMeshData* rendermesh_data = &iter->data;
+    // Entities that are never culled are always drawn anyway.
+    if (rendermesh_data->culling_mask == 0) continue;
+    if (!IsStatic(world, iter->entity)) continue;
+    // Streamed props come and go with the raft, so they are added below,
+    // whether or not they are loaded.
+    if (world->level_streamer.streaming() &&
+        IsScenery(world, iter->entity)) {
+      continue;
+    }
+
+    const mat4 world_transform =
+        world->transform_component.WorldTransform(iter->entity);
+    vec3 center = world_transform.TranslationVector3D();
+    float radius = 0.0f;
+    if (rendermesh_data->mesh != nullptr) {
+      const vec3 min_position = rendermesh_data->mesh->min_position();
+      const vec3 max_position = rendermesh_data->mesh->max_position();
+      center = world_transform * ((min_position + max_position) * 0.5f);
+      float scale = 0.0f;
+      for (int i = 0; i < 3; ++i) {
+        scale = std::max(scale, world_transform.GetColumn(i).xyz().Length());
+      }
+      radius = (max_position - min_position).Length() * 0.5f * scale;
+    }
+    entities_.push_back(iter->entity);
+    centers.push_back(center);
+    radii.push_back(radius);
+  }
+  pass_masks_.resize(entities_.size(), 0);
+
+  props_begin_ = entities_.size();
+  if (world->level_streamer.streaming()) {
+    LevelStreamer& level_streamer = world->level_streamer;
+    prop_indices_.assign(level_streamer.num_props(), kNoProp);
+    for (size_t i = 0; i < level_streamer.num_props(); ++i) {
+      vec3 center;
+      float radius;
+      if (!level_streamer.PropBounds(world, i, &center, &radius)) continue;
+      prop_indices_[i] = static_cast<uint32_t>(entities_.size());
+      entities_.push_back(level_streamer.prop_entity(i));
+      centers.push_back(center);
+      radii.push_back(radius);
+    }
+  }
+  prop_pass_masks_.resize(entities_.size() - props_begin_);
+  hidden_.resize(entities_.size(), 0);
+
+  // An entity is potentially visible from a segment if it is within cull
+  // distance of any point the raft passes through in that segment. The margin
+  // covers the camera's offset from the raft's rail. The raft's path is the
+  // rail moved into place by the same transform RailDenizenComponent applies
+  // to the raft every frame, so the rail's lookup grid can find the points
+  // near each entity.
+  const float reach =
+      render_config->cull_distance() + render_config->pvs_margin();
+  const vec3& scale = raft_data->rail_scale;
+  const float min_scale = std::max(
+      std::min(std::min(fabsf(scale.x), fabsf(scale.y)), fabsf(scale.z)),
+      std::numeric_limits<float>::epsilon());
+  std::vector<std::vector<uint32_t>> visible_sets(segment_count);
+  std::vector<int> sample_indices;
+  for (size_t i = 0; i < entities_.size(); ++i) {
+    const float max_distance = reach + radii[i];
+    const float max_distance_squared = max_distance * max_distance;
+    const vec3 rail_center =
+        raft_data->rail_orientation *
+        ((centers[i] - raft_data->rail_offset) / scale);
+    rail.SamplesWithin(rail_center, max_distance / min_scale,
+                       &sample_indices);
+
+    int last_segment = kNoSegment;
+    for (auto it = sample_indices.begin(); it != sample_indices.end(); ++it) {
+      const float time = *it * rail.sample_delta_time();
+      const int segment = std::min(
+          static_cast<int>(time / end_time * segment_count), segment_count - 1);
+      if (segment == last_segment) continue;
+      vec3 position = raft_data->rail_orientation.Inverse() * rail.Sample(*it);
+      position *= scale;
+      position += raft_data->rail_offset;
+      if ((position - centers[i]).LengthSquared() <= max_distance_squared) {
+        visible_sets[segment].push_back(static_cast<uint32_t>(i));
+        last_segment = segment;
+      }
+    }
+  }
+
+  segment_offsets_.reserve(segment_count + 1);
+  for (int segment = 0; segment < segment_count; ++segment) {
+    segment_offsets_.push_back(
+        static_cast<uint32_t>(segment_entities_.size()));
+    segment_entities_.insert(segment_entities_.end(),
+                             visible_sets[segment].begin(),
+                             visible_sets[segment].end());
+  }
+  segment_offsets_.push_back(static_cast<uint32_t>(segment_entities_.size()));
+
+  fplbase::LogInfo(
+      "RailVisibility: %d segments, %d static entities, %d streamed props, "
+      "%d visible on average",
+      segment_count, static_cast<int>(props_begin_),
+      static_cast<int>(entities_.size() - props_begin_),
+      static_cast<int>(segment_entities_.size() / segment_count));
+  current_segment_ = kNoSegment;
+  enabled_ = true;
+}
+
+void RailVisibility::Update(World* world) {
+  if (!enabled_) return;
+
+  const RailDenizenData* raft_data =
+      world->entity_manager.GetComponentData<RailDenizenData>(
+          world->services_component.raft_entity());
+  if (raft_data == nullptr) return;
+
+  const int segment_count = static_cast<int>(segment_offsets_.size()) - 1;
+  const int segment = std::max(
+      0, std::min(static_cast<int>(raft_data->lap_progress * segment_count),
+                  segment_count - 1));
+  if (segment == current_segment_) return;
+  current_segment_ = segment;
+
+  // Hide everything not in the new segment's set, and show everything in it.
+  std::vector<uint8_t> should_hide(entities_.size(), 1);
+  for (uint32_t i = segment_offsets_[segment];
+       i < segment_offsets_[segment + 1]; ++i) {
+    should_hide[segment_entities_[i]] = 0;
+  }
+  for (size_t i = 0; i < entities_.size(); ++i) {
+    if (should_hide[i] != hidden_[i]) {
+      SetHidden(world, i, should_hide[i] != 0);
+    }
+  }
+}
+
+void RailVisibility::Reset(World* world) {
+  for (size_t i = 0; i < entities_.size(); ++i) {
+    if (hidden_[i]) {
+      SetHidden(world, i, false);
+    }
+  }
+  current_segment_ = kNoSegment;
+  enabled_ = false;
+}
+
+void RailVisibility::AttachProp(World* world, size_t index,
+                                corgi::EntityRef entity) {
+  if (!enabled_ || index >= prop_indices_.size() ||
+      prop_indices_[index] == kNoProp) {
+    return;
+  }
+  const size_t entity_index = prop_indices_[index];
+  entities_[entity_index] = entity;
+  if (hidden_[entity_index]) SetHidden(world, entity_index, true);
+}
+
+void RailVisibility::DetachProp(size_t index) {
+  if (index >= prop_indices_.size() || prop_indices_[index] == kNoProp) {
+    return;
+  }
+  // The prop stays hidden or shown, so it is hidden again if it is created
+  // while the raft is in a segment that can't see it.
+  const size_t entity_index = prop_indices_[index];
+  entities_[entity_index] = corgi::EntityRef();
+  prop_pass_masks_[entity_index - props_begin_].clear();
+}
+
+// Take every render mesh at or under `entity` out of every render pass,
+// appending their pass masks to `pass_masks`.
+static void HideRecursively(World* world, corgi::EntityRef entity,
+                            std::vector<uint32_t>* pass_masks) {
+  RenderMeshData* rendermesh_data =
+      world->entity_manager.GetComponentData<RenderMeshData>(entity);
+  if (rendermesh_data != nullptr) {
+    pass_masks->push_back(rendermesh_data->pass_mask);
+    rendermesh_data->pass_mask = 0;
+  }
+  const TransformData* transform_data =
+      world->entity_manager.GetComponentData<TransformData>(entity);
+  if (transform_data == nullptr) return;
+  for (auto iter = transform_data->children.begin();
+       iter != transform_data->children.end(); ++iter) {
+    HideRecursively(world, iter->owner, pass_masks);
+  }
+}
+
+// Undo HideRecursively, restoring the pass masks in the same order, from
+// `*next` on.
+static void ShowRecursively(World* world, corgi::EntityRef entity,
+                            const std::vector<uint32_t>& pass_masks,
+                            size_t* next) {
+  RenderMeshData* rendermesh_data =
+      world->entity_manager.GetComponentData<RenderMeshData>(entity);
+  if (rendermesh_data != nullptr && *next < pass_masks.size()) {
+    rendermesh_data->pass_mask = pass_masks[(*next)++];
+  }
+  const TransformData* transform_data =
+      world->entity_manager.GetComponentData<TransformData>(entity);
+  if (transform_data == nullptr) return;
+  for (auto iter = transform_data->children.begin();
+       iter != transform_data->children.end(); ++iter) {
+    ShowRecursively(world, iter->owner, pass_masks, next);
+  }
+}
+
+void RailVisibility::SetHidden(World* world, size_t index, bool hidden) {
+  hidden_[index] = hidden ? 1 : 0;
+  corgi::EntityRef& entity = entities_[index];
+  if (!entity.IsValid()) return;
+
+  // Game logic owns the `visible` flag, so hide by removing the entity from
+  // every render pass instead.
+  if (index >= props_begin_) {
+    std::vector<uint32_t>& pass_masks = prop_pass_masks_[index - props_begin_];
+    if (hidden) {
+      pass_masks.clear();
+      HideRecursively(world, entity, &pass_masks);
+    } else {
+      size_t next = 0;
+      ShowRecursively(world, entity, pass_masks, &next);
+      pass_masks.clear();
+    }
+    return;
+  }
+
+  RenderMeshData* rendermesh_data =
+      world->entity_manager.GetComponentData<RenderMeshData>(entity);
+  if (rendermesh_data == nullptr) return;
+  if (hidden) {
+    pass_masks_[index] = rendermesh_data->pass_mask;
+    rendermesh_data->pass_mask = 0;
+  } else {
+    rendermesh_data->pass_mask = pass_masks_[index];
+  }
+}
+
+}  // zooshi
+}  // fpl
@@ -0,0 +1,105 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ZOOSHI_RAIL_VISIBILITY_H_
+#define ZOOSHI_RAIL_VISIBILITY_H_
+
+#include <cstdint>
+#include <vector>
+#include "corgi/entity_manager.h"
+
+namespace fpl {
+namespace zooshi {
+
+struct World;
+
+// Potentially-visible sets of static render meshes, one per segment of the
+// rail that the raft travels along. The camera always rides the raft, so
+// anything that is not in the set of the raft's current segment can never
+// pass the distance cull. Those entities are taken out of every render pass
+// instead of being culled again each frame.
+class RailVisibility {
+ public:
+  RailVisibility()
+      : props_begin_(0), current_segment_(kNoSegment), enabled_(false) {}
+
+  // Compute the visible sets from the raft's rail, the static entities
+  // currently in the world, and the level streamer's props, loaded or not.
+  // Discards any previous bake.
+  void Bake(World* world);
+
+  // Show or hide the baked entities based on the raft's current rail segment.
+  // Entities are only touched when the segment changes.
+  void Update(World* world);
+
+  // Restore every entity hidden by the visible sets, and stop updating until
+  // the next Bake.
+  void Reset(World* world);
+
+  // Called by the level streamer when it creates `entity` for the prop at
+  // `index`, to hide it if it isn't in the current segment's set.
+  void AttachProp(World* world, size_t index, corgi::EntityRef entity);
+
+  // Called by the level streamer before it deletes the prop at `index`.
+  void DetachProp(size_t index);
+
+  // Whether neither `entity` nor any of its parents is driven by a component
+  // that moves it, such as a rail or the player.
+  static bool IsStatic(World* world, corgi::EntityRef entity);
+
+  // Whether `entity` or any of its parents is scenery.
+  static bool IsScenery(World* world, corgi::EntityRef entity);
+
+ private:
+  static const int kNoSegment = -1;
+  static const uint32_t kNoProp = 0xFFFFFFFF;
+
+  void SetHidden(World* world, size_t index, bool hidden);
+
+  // Every static entity with a render mesh, followed by the root of each
+  // streamed prop that has meshes, or an invalid entity while the prop isn't
+  // loaded. A prop is hidden along with every render mesh under it.
+  std::vector<corgi::EntityRef> entities_;
+
+  // The index in `entities_` of the first streamed prop.
+  size_t props_begin_;
+
+  // The index in `entities_` of each of the level streamer's props, or
+  // kNoProp if the prop isn't in the visible sets.
+  std::vector<uint32_t> prop_indices_;
+
+  // The pass mask of each static entity in `entities_` before it was hidden.
+  std::vector<uint32_t> pass_masks_;
+
+  // The pass masks of each streamed prop's render meshes before it was
+  // hidden, in the order they were hidden in.
+  std::vector<std::vector<uint32_t>> prop_pass_masks_;
+
+  // Whether each entity in `entities_` is currently hidden.
+  std::vector<uint8_t> hidden_;
+
+  // The visible set of segment `i` is the range
+  // [segment_offsets_[i], segment_offsets_[i + 1]) of `segment_entities_`,
+  // holding indices into `entities_`.
+  std::vector<uint32_t> segment_offsets_;
+  std::vector<uint32_t> segment_entities_;
+
+  int current_segment_;
+  bool enabled_;
+};
+
+}  // zooshi
+}  // fpl
+
+#endif  // ZOOSHI_RAIL_VISIBILITY_H_
@@ -14,6 +14,9 @@
 
 #include "railmanager.h"
 
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
 #include <map>
 #include "components/rail_denizen.h"
 #include "components/rail_node.h"
@@ -29,6 +32,49 @@ namespace zooshi {
 
 static const float kSplineGranularity = 10.0f;
 
+// Number of lookup samples taken between each pair of rail nodes.
+static const int kLookupSamplesPerNode = 8;
+
+// Grid cells are sized to hold about this many segments of the rail, but the
+// grid is never more than kMaxGridCells cells across.
+static const float kSegmentsPerGridCell = 4.0f;
+static const int kMaxGridCells = 256;
+
+// Identifies rail cache files, and the layout of their contents. Bump the
+// version whenever the way splines are built from rail nodes changes.
+static const uint32_t kRailCacheMagic = 0x4c524343;  // "CCRL"
+static const uint32_t kRailCacheVersion = 2;
+
+// Cache files are kept in the same directory as the save data.
+static const char kRailCacheAppName[] = "zooshi";
+
+// The splines follow the header directly, as laid out by
+// CompactSpline::CreateArray(), and are followed by the node positions and
+// times.
+struct RailCacheHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t hash;
+  uint32_t spline_size;
+  uint32_t num_splines;
+  uint32_t num_nodes;
+  uint32_t wraps;
+};
+
+// 64-bit FNV-1a hash, used to tell whether a cached rail was built from the
+// same source data.
+static uint64_t HashRailData(const void *data, size_t size, uint64_t hash) {
+  const uint8_t *bytes = static_cast<const uint8_t *>(data);
+  for (size_t i = 0; i < size; ++i) {
+    hash = (hash ^ bytes[i]) * 1099511628211ull;
+  }
+  return hash;
+}
+
+static uint64_t HashRailData(const void *data, size_t size) {
+  return HashRailData(data, size, 14695981039346656037ull);
+}
+
 using mathfu::vec3;
 using mathfu::vec3_packed;
 
@@ -72,7 +118,12 @@ void Rail::InitializeFromPositions(const std::vector<vec3_packed> &positions,
     position_max = vec3::Max(position_max, position);
   }
 
-  // Create array of splines. Destroyed in Rail's destructor.
+  // Create array of splines. Destroyed in Rail's destructor, or here when the
+  // rail is rebuilt in place.
+  FreeSplines();
+  num_nodes_ = static_cast<int>(num_positions);
+  node_positions_ = positions;
+  node_times_ = times;
   splines_ = motive::CompactSpline::CreateArray(
       2 * static_cast<motive::CompactSplineIndex>(num_positions), kDimensions);
 
@@ -96,6 +147,300 @@ void Rail::InitializeFromPositions(const std::vector<vec3_packed> &positions,
       Spline(i)->AddNode(t, position[i], derivative[i]);
     }
   }
+
+  BuildLookupTables(static_cast<int>(num_positions));
+}
+
+void Rail::FreeSplines() {
+  if (cache_file_.is_open()) {
+    cache_file_.Close();
+  } else if (splines_ != nullptr) {
+    motive::CompactSpline::DestroyArray(splines_, kDimensions);
+  }
+  splines_ = nullptr;
+}
+
+bool Rail::LoadCache(const char *filename, uint64_t hash) {
+  FreeSplines();
+  if (!cache_file_.Open(filename)) return false;
+
+  RailCacheHeader header;
+  if (cache_file_.size() < sizeof(header)) {
+    cache_file_.Close();
+    return false;
+  }
+  memcpy(&header, cache_file_.data(), sizeof(header));
+  const bool valid =
+      header.magic == kRailCacheMagic &&
+      header.version == kRailCacheVersion && header.hash == hash &&
+      header.spline_size >= sizeof(motive::CompactSpline) &&
+      header.num_splines == kDimensions && header.num_nodes > 0 &&
+      cache_file_.size() ==
+          sizeof(header) + header.spline_size * header.num_splines +
+              header.num_nodes * (sizeof(vec3_packed) + sizeof(float));
+  if (!valid) {
+    cache_file_.Close();
+    return false;
+  }
+
+  // The splines are only ever read, so they can stay in the mapped pages.
+  splines_ = reinterpret_cast<motive::CompactSpline *>(
+      const_cast<uint8_t *>(cache_file_.data() + sizeof(header)));
+  wraps_ = header.wraps != 0;
+  num_nodes_ = static_cast<int>(header.num_nodes);
+  const uint8_t *nodes = cache_file_.data() + sizeof(header) +
+                         header.spline_size * header.num_splines;
+  node_positions_.resize(header.num_nodes);
+  memcpy(node_positions_.data(), nodes,
+         header.num_nodes * sizeof(vec3_packed));
+  node_times_.resize(header.num_nodes);
+  memcpy(node_times_.data(), nodes + header.num_nodes * sizeof(vec3_packed),
+         header.num_nodes * sizeof(float));
+  BuildLookupTables(num_nodes_);
+  return true;
+}
+
+// The cache is written to a temporary file first, so that a partly written
+// cache is never loaded.
+void Rail::SaveCache(const char *filename, uint64_t hash) const {
+  if (splines_ == nullptr) return;
+  const std::string cache_filename(filename);
+  const std::string temp_filename = cache_filename + ".tmp";
+  FILE *file = fopen(temp_filename.c_str(), "wb");
+  if (file == nullptr) {
+    fplbase::LogError("RailManager: Couldn't write %s", temp_filename.c_str());
+    return;
+  }
+
+  RailCacheHeader header;
+  header.magic = kRailCacheMagic;
+  header.version = kRailCacheVersion;
+  header.hash = hash;
+  header.spline_size = static_cast<uint32_t>(splines_->Size());
+  header.num_splines = kDimensions;
+  header.num_nodes = static_cast<uint32_t>(num_nodes_);
+  header.wraps = wraps_ ? 1 : 0;
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+            fwrite(splines_, header.spline_size, header.num_splines, file) ==
+                header.num_splines &&
+            fwrite(node_positions_.data(), sizeof(vec3_packed),
+                   node_positions_.size(), file) == node_positions_.size() &&
+            fwrite(node_times_.data(), sizeof(float), node_times_.size(),
+                   file) == node_times_.size();
+  ok = fclose(file) == 0 && ok;
+
+  // rename() won't replace an existing file on every platform.
+  remove(cache_filename.c_str());
+  if (!ok || rename(temp_filename.c_str(), cache_filename.c_str()) != 0) {
+    fplbase::LogError("RailManager: Couldn't write %s",
+                      cache_filename.c_str());
+    remove(temp_filename.c_str());
+  }
+}
+
+void Rail::BuildLookupTables(int num_nodes) {
+  sample_delta_time_ =
+      EndTime() / static_cast<float>(std::max(num_nodes, 1) *
+                                     kLookupSamplesPerNode);
+  samples_.clear();
+  sample_distances_.clear();
+  grid_offsets_.clear();
+  grid_segments_.clear();
+  grid_width_ = 0;
+  grid_height_ = 0;
+  if (sample_delta_time_ <= 0.0f) return;
+  Positions(sample_delta_time_, &samples_);
+
+  const int num_samples = static_cast<int>(samples_.size());
+  sample_distances_.resize(num_samples);
+  float distance = 0.0f;
+  float min_x = samples_[0].data[0];
+  float min_y = samples_[0].data[1];
+  float max_x = min_x;
+  float max_y = min_y;
+  for (int i = 0; i < num_samples; ++i) {
+    if (i > 0) distance += (Sample(i) - Sample(i - 1)).Length();
+    sample_distances_[i] = distance;
+    min_x = std::min(min_x, samples_[i].data[0]);
+    min_y = std::min(min_y, samples_[i].data[1]);
+    max_x = std::max(max_x, samples_[i].data[0]);
+    max_y = std::max(max_y, samples_[i].data[1]);
+  }
+  if (num_samples < 2) return;
+
+  const int num_segments = num_samples - 1;
+  const float extent = std::max(max_x - min_x, max_y - min_y);
+  grid_cell_size_ = std::max(
+      std::max(distance / num_segments * kSegmentsPerGridCell,
+               extent / (kMaxGridCells - 1)),
+      std::numeric_limits<float>::epsilon());
+  grid_min_x_ = min_x;
+  grid_min_y_ = min_y;
+  grid_width_ = static_cast<int>((max_x - min_x) / grid_cell_size_) + 1;
+  grid_height_ = static_cast<int>((max_y - min_y) / grid_cell_size_) + 1;
+
+  // Count the segments overlapping each cell, then fill the cells in.
+  grid_offsets_.assign(grid_width_ * grid_height_ + 1, 0);
+  for (int pass = 0; pass < 2; ++pass) {
+    for (int i = 0; i < num_segments; ++i) {
+      const vec3_packed &a = samples_[i];
+      const vec3_packed &b = samples_[i + 1];
+      const int first_column = GridColumn(std::min(a.data[0], b.data[0]));
+      const int last_column = GridColumn(std::max(a.data[0], b.data[0]));
+      const int first_row = GridRow(std::min(a.data[1], b.data[1]));
+      const int last_row = GridRow(std::max(a.data[1], b.data[1]));
+      for (int row = first_row; row <= last_row; ++row) {
+        for (int column = first_column; column <= last_column; ++column) {
+          const int cell = row * grid_width_ + column;
+          if (pass == 0) {
+            ++grid_offsets_[cell + 1];
+          } else {
+            grid_segments_[grid_offsets_[cell]++] = static_cast<uint32_t>(i);
+          }
+        }
+      }
+    }
+    if (pass == 0) {
+      for (size_t c = 1; c < grid_offsets_.size(); ++c) {
+        grid_offsets_[c] += grid_offsets_[c - 1];
+      }
+      grid_segments_.resize(grid_offsets_.back());
+    } else {
+      // Filling each cell moved its offset to the start of the next one.
+      for (size_t c = grid_offsets_.size() - 1; c > 0; --c) {
+        grid_offsets_[c] = grid_offsets_[c - 1];
+      }
+      grid_offsets_[0] = 0;
+    }
+  }
+}
+
+int Rail::GridColumn(float x) const {
+  const int column = static_cast<int>((x - grid_min_x_) / grid_cell_size_);
+  return std::max(0, std::min(column, grid_width_ - 1));
+}
+
+int Rail::GridRow(float y) const {
+  const int row = static_cast<int>((y - grid_min_y_) / grid_cell_size_);
+  return std::max(0, std::min(row, grid_height_ - 1));
+}
+
+float Rail::DistanceAtTime(float time) const {
+  if (samples_.size() < 2) return 0.0f;
+  const float sample = std::max(time / sample_delta_time_, 0.0f);
+  const int index = std::min(static_cast<int>(sample), num_samples() - 2);
+  const float fraction = std::min(sample - index, 1.0f);
+  return sample_distances_[index] +
+         (sample_distances_[index + 1] - sample_distances_[index]) * fraction;
+}
+
+float Rail::TimeAtDistance(float distance) const {
+  if (samples_.size() < 2) return 0.0f;
+  const auto next = std::upper_bound(sample_distances_.begin() + 1,
+                                     sample_distances_.end() - 1, distance);
+  const int index = static_cast<int>(next - sample_distances_.begin()) - 1;
+  const float length =
+      sample_distances_[index + 1] - sample_distances_[index];
+  const float fraction =
+      length > 0.0f ? mathfu::Clamp((distance - sample_distances_[index]) /
+                                        length,
+                                    0.0f, 1.0f)
+                    : 0.0f;
+  return (index + fraction) * sample_delta_time_;
+}
+
+float Rail::ClosestTime(const vec3 &position, float *distance_squared) const {
+  float best_distance_squared = std::numeric_limits<float>::infinity();
+  float best_time = 0.0f;
+  if (samples_.size() < 2) {
+    if (!samples_.empty()) {
+      best_distance_squared = (Sample(0) - position).LengthSquared();
+    }
+    if (distance_squared != nullptr) *distance_squared = best_distance_squared;
+    return best_time;
+  }
+
+  // Search rings of cells outwards from the one holding `position`, until
+  // every cell left is further away than the closest point found so far.
+  const int center_column = GridColumn(position.x);
+  const int center_row = GridRow(position.y);
+  const int max_ring = std::max(grid_width_, grid_height_);
+  for (int ring = 0; ring <= max_ring; ++ring) {
+    for (int row = center_row - ring; row <= center_row + ring; ++row) {
+      if (row < 0 || row >= grid_height_) continue;
+      // Only the first and last rows of a ring are filled in.
+      const bool whole_row =
+          row == center_row - ring || row == center_row + ring;
+      const int step = whole_row ? 1 : 2 * ring;
+      for (int column = center_column - ring; column <= center_column + ring;
+           column += step) {
+        if (column < 0 || column >= grid_width_) continue;
+        const int cell = row * grid_width_ + column;
+        for (uint32_t s = grid_offsets_[cell]; s < grid_offsets_[cell + 1];
+             ++s) {
+          const int i = static_cast<int>(grid_segments_[s]);
+          const vec3 start = Sample(i);
+          const vec3 along = Sample(i + 1) - start;
+          const float length_squared = along.LengthSquared();
+          const float fraction =
+              length_squared > 0.0f
+                  ? mathfu::Clamp(
+                        vec3::DotProduct(position - start, along) /
+                            length_squared,
+                        0.0f, 1.0f)
+                  : 0.0f;
+          const float segment_distance_squared =
+              (start + along * fraction - position).LengthSquared();
+          if (segment_distance_squared < best_distance_squared) {
+            best_distance_squared = segment_distance_squared;
+            best_time = (i + fraction) * sample_delta_time_;
+          }
+        }
+      }
+    }
+    // Cells beyond this ring are at least `ring` cells away.
+    const float searched_distance = ring * grid_cell_size_;
+    if (best_distance_squared <= searched_distance * searched_distance) break;
+  }
+
+  if (distance_squared != nullptr) *distance_squared = best_distance_squared;
+  return best_time;
+}
+
+void Rail::SamplesWithin(const vec3 &position, float radius,
+                         std::vector<int> *indices) const {
+  indices->clear();
+  if (samples_.size() < 2) {
+    if (!samples_.empty() &&
+        (Sample(0) - position).LengthSquared() <= radius * radius) {
+      indices->push_back(0);
+    }
+    return;
+  }
+
+  const float radius_squared = radius * radius;
+  const int first_column = GridColumn(position.x - radius);
+  const int last_column = GridColumn(position.x + radius);
+  const int first_row = GridRow(position.y - radius);
+  const int last_row = GridRow(position.y + radius);
+  for (int row = first_row; row <= last_row; ++row) {
+    for (int column = first_column; column <= last_column; ++column) {
+      const int cell = row * grid_width_ + column;
+      for (uint32_t s = grid_offsets_[cell]; s < grid_offsets_[cell + 1];
+           ++s) {
+        // Each sample is the start or end of a segment in its own cell.
+        const int i = static_cast<int>(grid_segments_[s]);
+        for (int j = i; j <= i + 1; ++j) {
+          if ((Sample(j) - position).LengthSquared() <= radius_squared) {
+            indices->push_back(j);
+          }
+        }
+      }
+    }
+  }
+  std::sort(indices->begin(), indices->end());
+  indices->erase(std::unique(indices->begin(), indices->end()),
+                 indices->end());
 }
 
 Rail *RailManager::GetRail(RailId rail_file) {
@@ -112,24 +457,70 @@ Rail *RailManager::GetRail(RailId rail_file) {
   return rail_map[rail_file].get();
 }
 
-Rail *RailManager::GetRailFromComponents(const char *rail_name,
-                                         corgi::EntityManager *entity_manager) {
-  std::map<float, corgi::EntityRef> rail_entities;
+// Build `rail` from its nodes' positions, or load it from the cache if it was
+// built from the same nodes before. The cache file is named after the rail,
+// and is only used if it was built from the same positions and settings, by
+// the same version of this code and of CompactSpline.
+static void InitializeCachedRail(Rail *rail, const char *rail_name,
+                                 const std::vector<vec3_packed> &positions,
+                                 float reliable_distance, float total_time,
+                                 bool wraps) {
+  const float spline_granularity = kSplineGranularity;
+  const uint32_t spline_size = sizeof(motive::CompactSpline);
+  const uint8_t wraps_byte = wraps ? 1 : 0;
+  uint64_t hash = HashRailData(positions.data(),
+                               positions.size() * sizeof(positions[0]));
+  hash = HashRailData(&total_time, sizeof(total_time), hash);
+  hash = HashRailData(&reliable_distance, sizeof(reliable_distance), hash);
+  hash = HashRailData(&wraps_byte, sizeof(wraps_byte), hash);
+  hash = HashRailData(&kRailCacheVersion, sizeof(kRailCacheVersion), hash);
+  hash = HashRailData(&spline_granularity, sizeof(spline_granularity), hash);
+  hash = HashRailData(&spline_size, sizeof(spline_size), hash);
 
-  auto *rail_component = entity_manager->GetComponent<RailNodeComponent>();
-  for (auto i = rail_component->begin(); i != rail_component->end(); ++i) {
-    if (i->data.rail_name == rail_name) {
-      rail_entities[i->data.ordering] = i->entity;
-    }
+  std::string cache_filename;
+  if (fplbase::GetStoragePath(kRailCacheAppName, &cache_filename)) {
+    char filename[64];
+    snprintf(filename, sizeof(filename), "rail_%016llx.bin",
+             static_cast<unsigned long long>(
+                 HashRailData(rail_name, strlen(rail_name))));
+    cache_filename += filename;
+  }
+
+  if (cache_filename.empty() ||
+      !rail->LoadCache(cache_filename.c_str(), hash)) {
+    rail->InitializeFromPositions(positions, kSplineGranularity,
+                                  reliable_distance, total_time, wraps);
+    if (!cache_filename.empty()) rail->SaveCache(cache_filename.c_str(), hash);
   }
+}
 
-  if (rail_entities.size() == 0) {
+Rail *RailManager::GetRailFromComponents(const char *rail_name,
+                                         corgi::EntityManager *entity_manager) {
+  auto *rail_component = entity_manager->GetComponent<RailNodeComponent>();
+  const RailNodeComponent::RailNodes *rail_nodes =
+      rail_component->GetRailNodes(rail_name);
+  if (rail_nodes == nullptr || rail_nodes->entities.empty()) {
     fplbase::LogInfo(
         "RailManager: No RailNode entities with rail_name '%s' found",
         rail_name);
     return nullptr;  // invalid rail name
   }
 
+  // Nothing to do if none of the rail's nodes have changed since it was
+  // built.
+  auto old_rail = rail_map.find(rail_name);
+  auto built_version = rail_versions_.find(rail_name);
+  if (old_rail != rail_map.end() && built_version != rail_versions_.end() &&
+      built_version->second == rail_nodes->version) {
+    return old_rail->second.get();
+  }
+
+  std::map<float, corgi::EntityRef> rail_entities;
+  for (auto i = rail_nodes->entities.begin(); i != rail_nodes->entities.end();
+       ++i) {
+    rail_entities[rail_component->GetComponentData(*i)->ordering] = *i;
+  }
+
   std::vector<vec3_packed> positions;
   const RailNodeData *first_data =
       rail_component->GetComponentData(rail_entities.begin()->second);
@@ -153,26 +544,33 @@ Rail *RailManager::GetRailFromComponents(const char *rail_name,
     positions[i] =
         transform_component->WorldPosition(rail_entities.begin()->second);
   }
+  rail_versions_[rail_name] = rail_nodes->version;
 
-  // Create a new rail with the requested positions.
-  Rail *new_rail = new Rail();
-  new_rail->InitializeFromPositions(
-      positions, kSplineGranularity, reliable_distance, total_time, wraps);
-
-  // Update anything that may be using the old rail.
-  auto old_rail = rail_map.find(rail_name);
+  // Rebuild an existing rail in place, so that anything holding on to it
+  // stays valid, and move the denizens following it onto its new splines
+  // from wherever they had got to. Rails are only rebuilt while their nodes
+  // are being edited, so these aren't cached.
   if (old_rail != rail_map.end()) {
-    auto *rail_denizen_component =
-        entity_manager->GetComponent<RailDenizenComponent>();
-    rail_denizen_component->ChangeRail(old_rail->second.get(), new_rail);
+    Rail *rail = old_rail->second.get();
+    rail->InitializeFromPositions(positions, kSplineGranularity,
+                                  reliable_distance, total_time, wraps);
+    entity_manager->GetComponent<RailDenizenComponent>()->RebindRail(rail);
+    return rail;
   }
 
-  // Cache this until we request the rail from these components again.
+  // Create a new rail with the requested positions, and keep it until its
+  // nodes change.
+  Rail *new_rail = new Rail();
+  InitializeCachedRail(new_rail, rail_name, positions, reliable_distance,
+                       total_time, wraps);
   rail_map[rail_name] = std::unique_ptr<Rail>(new_rail);
   return new_rail;
 }
 
-void RailManager::Clear() { rail_map.clear(); }
+void RailManager::Clear() {
+  rail_map.clear();
+  rail_versions_.clear();
+}
 
 }  // zooshi
 }  // fpl
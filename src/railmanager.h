@@ -19,6 +19,7 @@
 #include <unordered_map>
 #include "components_generated.h"
 #include "corgi/entity_manager.h"
+#include "mapped_file.h"
 #include "mathfu/glsl_mappings.h"
 #include "motive/math/compact_spline.h"
 #include "rail_def_generated.h"
@@ -30,11 +31,30 @@ typedef std::string RailId;
 
 class Rail {
  public:
-  Rail() : splines_(nullptr), wraps_(true) {}
-  ~Rail() { motive::CompactSpline::DestroyArray(splines_, kDimensions); }
+  Rail()
+      : splines_(nullptr),
+        wraps_(true),
+        num_nodes_(0),
+        sample_delta_time_(0.0f),
+        grid_min_x_(0.0f),
+        grid_min_y_(0.0f),
+        grid_cell_size_(1.0f),
+        grid_width_(0),
+        grid_height_(0) {}
+  ~Rail() { FreeSplines(); }
 
   void Initialize(const RailDef* rail_def, float spline_granularity);
 
+  /// Use the splines saved in the cache file `filename` by SaveCache(), if
+  /// they were built from source data with the same `hash`. The splines are
+  /// used straight from the mapped file, rather than being copied. Returns
+  /// false if the rail has to be initialized some other way.
+  bool LoadCache(const char* filename, uint64_t hash);
+
+  /// Save the rail's splines to `filename`, tagged with the `hash` of the
+  /// source data they were built from.
+  void SaveCache(const char* filename, uint64_t hash) const;
+
   /// Return vector of `positions` that is the rail evaluated every `delta_time`
   /// for the entire course of the rail. This calculation is much faster than
   /// calling PositionCalculatedSlowly() multiple times.
@@ -60,6 +80,41 @@ class Rail {
   /// Does the rail wrap around to itself at the end.
   bool wraps() const { return wraps_; }
 
+  /// The positions the rail was built from, and the time at which the rail
+  /// passes through each of them.
+  const std::vector<mathfu::vec3_packed>& node_positions() const {
+    return node_positions_;
+  }
+  const std::vector<float>& node_times() const { return node_times_; }
+
+  /// Length of the rail in world units, as opposed to EndTime().
+  float Length() const {
+    return sample_distances_.empty() ? 0.0f : sample_distances_.back();
+  }
+
+  /// Distance travelled along the rail from its start to `time`.
+  float DistanceAtTime(float time) const;
+
+  /// Time at which the rail has travelled `distance` from its start.
+  float TimeAtDistance(float distance) const;
+
+  /// Return the time of the point on the rail closest to `position`. If
+  /// `distance_squared` isn't null, it's set to the squared distance between
+  /// them. Much faster than searching with PositionCalculatedSlowly().
+  float ClosestTime(const mathfu::vec3& position,
+                    float* distance_squared) const;
+
+  /// Set `indices` to the sorted indices of the lookup samples within
+  /// `radius` of `position`.
+  void SamplesWithin(const mathfu::vec3& position, float radius,
+                     std::vector<int>* indices) const;
+
+  /// The rail's position at lookup sample `index`, which is at time
+  /// `index * sample_delta_time()`.
+  mathfu::vec3 Sample(int index) const { return mathfu::vec3(samples_[index]); }
+  int num_samples() const { return static_cast<int>(samples_.size()); }
+  float sample_delta_time() const { return sample_delta_time_; }
+
  private:
   static const motive::MotiveDimension kDimensions = 3;
 
@@ -68,11 +123,50 @@ class Rail {
     return const_cast<Rail*>(this)->Spline(idx);
   }
 
+  // Release the splines, whether they were allocated or mapped.
+  void FreeSplines();
+
+  // Sample the rail, measure the distance along it at each sample, and sort
+  // the segments between samples into a grid.
+  void BuildLookupTables(int num_nodes);
+
+  // Index of the grid cell column or row holding `x` or `y`, clamped to the
+  // grid.
+  int GridColumn(float x) const;
+  int GridRow(float y) const;
+
   // Points to the first of kDimension splines in contiguous memory.
   motive::CompactSpline* splines_;
 
+  // Holds `splines_` when they were loaded by LoadCache(), in which case
+  // they're read-only.
+  MappedFile cache_file_;
+
   // Does the rail wrap around to itself at the end.
   bool wraps_;
+
+  // Number of nodes the rail was built from, their positions, and the time
+  // at each of them.
+  int num_nodes_;
+  std::vector<mathfu::vec3_packed> node_positions_;
+  std::vector<float> node_times_;
+
+  // The rail evaluated every `sample_delta_time_`, and the distance along the
+  // rail at each sample.
+  std::vector<mathfu::vec3_packed> samples_;
+  std::vector<float> sample_distances_;
+  float sample_delta_time_;
+
+  // Grid over the rail's extent in x and y. Segment `i` runs from sample `i`
+  // to `i + 1`, and cell `c` holds the segments
+  // [grid_offsets_[c], grid_offsets_[c + 1]) of `grid_segments_`.
+  float grid_min_x_;
+  float grid_min_y_;
+  float grid_cell_size_;
+  int grid_width_;
+  int grid_height_;
+  std::vector<uint32_t> grid_offsets_;
+  std::vector<uint32_t> grid_segments_;
 };
 
 // Class for handling loading and storing of rails.
@@ -84,6 +178,10 @@ class RailManager {
   Rail* GetRail(RailId rail_file);
 
   // Returns the data for a rail specified by RailNodeComponent entities.
+  // The rail is only rebuilt when its nodes have changed since the last
+  // call, and is rebuilt in place, so the pointer stays the same. The splines
+  // built for a level's rails are cached on disk, keyed on the nodes they
+  // were built from, so loading the level again doesn't rebuild them.
   Rail* GetRailFromComponents(const char* rail_name,
                               corgi::EntityManager* entity_manager);
 
@@ -91,6 +189,9 @@ class RailManager {
 
  private:
   std::unordered_map<RailId, std::unique_ptr<Rail>> rail_map;
+  // The RailNodeComponent version of the nodes each rail in `rail_map` was
+  // last built from, for rails built from components.
+  std::unordered_map<RailId, unsigned int> rail_versions_;
 };
 
 }  // zooshi
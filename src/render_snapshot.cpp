@@ -0,0 +1,110 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "render_snapshot.h"
+
+namespace fpl {
+namespace zooshi {
+
+// Set in RenderSnapshotBuffer::ready_ when the writer publishes a snapshot,
+// and cleared when the reader takes it.
+static const int kFreshBit = 4;
+
+RenderSnapshot::RenderSnapshot()
+    : sequence(0),
+      stereoscopic(false),
+      shader_defines(0),
+      shader_defines_version(0),
+      ambient_material(mathfu::kZeros4f),
+      diffuse_material(mathfu::kZeros4f),
+      specular_material(mathfu::kZeros4f),
+      shininess(0.0f),
+      shadow_intensity(0.0f),
+      river_offset(0.0f),
+      texture_repeats(0.0f),
+      skip_rendermesh_rendering(false),
+      num_shadow_cascades(0),
+      static_shadow_version(0) {
+  for (int i = 0; i < kMaxShadowCascades; ++i) {
+    light_view_projections[i] = mathfu::mat4::Identity();
+    shadow_cascade_splits[i] = 0.0f;
+  }
+}
+
+void RenderSnapshot::Clear() {
+  for (int pass = 0; pass < corgi::RenderPass_Count; ++pass) {
+    draw_commands[pass].clear();
+  }
+  num_shadow_cascades = 0;
+  for (int i = 0; i < kMaxShadowCascades; ++i) {
+    static_shadow_casters[i].clear();
+    dynamic_shadow_casters[i].clear();
+  }
+  bones.clear();
+  texts.clear();
+}
+
+RenderSnapshotBuffer::RenderSnapshotBuffer()
+    : write_index_(0),
+      read_index_(1),
+      published_(0),
+      retired_mutex_(SDL_CreateMutex()) {
+  SDL_AtomicSet(&ready_, 2);
+}
+
+RenderSnapshotBuffer::~RenderSnapshotBuffer() {
+  for (auto iter = retired_meshes_.begin(); iter != retired_meshes_.end();
+       ++iter) {
+    delete iter->mesh;
+  }
+  SDL_DestroyMutex(retired_mutex_);
+}
+
+void RenderSnapshotBuffer::Publish() {
+  snapshots_[write_index_].sequence = ++published_;
+  write_index_ = SDL_AtomicSet(&ready_, write_index_ | kFreshBit) & ~kFreshBit;
+}
+
+const RenderSnapshot* RenderSnapshotBuffer::Acquire() {
+  if (SDL_AtomicGet(&ready_) & kFreshBit) {
+    read_index_ = SDL_AtomicSet(&ready_, read_index_) & ~kFreshBit;
+  }
+  const RenderSnapshot* snapshot = &snapshots_[read_index_];
+
+  // Meshes are retired in order, so stop at the first one that's still in
+  // use.
+  SDL_LockMutex(retired_mutex_);
+  size_t num_deleted = 0;
+  while (num_deleted < retired_meshes_.size() &&
+         retired_meshes_[num_deleted].sequence <= snapshot->sequence) {
+    delete retired_meshes_[num_deleted].mesh;
+    ++num_deleted;
+  }
+  retired_meshes_.erase(retired_meshes_.begin(),
+                        retired_meshes_.begin() + num_deleted);
+  SDL_UnlockMutex(retired_mutex_);
+  return snapshot;
+}
+
+void RenderSnapshotBuffer::RetireMesh(fplbase::Mesh* mesh) {
+  RetiredMesh retired;
+  retired.mesh = mesh;
+  retired.sequence = published_ + 1;
+  SDL_LockMutex(retired_mutex_);
+  retired_meshes_.push_back(retired);
+  SDL_UnlockMutex(retired_mutex_);
+}
+
+}  // zooshi
+}  // fpl
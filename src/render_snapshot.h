@@ -0,0 +1,173 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ZOOSHI_RENDER_SNAPSHOT_H_
+#define ZOOSHI_RENDER_SNAPSHOT_H_
+
+#include <vector>
+#include "SDL_atomic.h"
+#include "SDL_mutex.h"
+#include "camera.h"
+#include "components/render_3d_text.h"
+#include "corgi_component_library/rendermesh.h"
+#include "fplbase/mesh.h"
+#include "fplbase/shader.h"
+#include "mathfu/glsl_mappings.h"
+
+namespace fpl {
+namespace zooshi {
+
+// The shadow map is an atlas with one cascade in each of up to three of its
+// quadrants.
+static const int kMaxShadowCascades = 3;
+
+// A mesh to draw into the shadow map, as it was when the snapshot was taken.
+struct ShadowCasterSnapshot {
+  fplbase::Mesh* mesh;
+  fplbase::Shader* shader;
+  mathfu::AffineTransform world_transform;
+  // The mesh's pose is RenderSnapshot::bones[first_bone] onwards. Meshes that
+  // aren't skinned have no bones.
+  int first_bone;
+  int num_bones;
+};
+
+// A mesh to draw in one of the main render passes, with every uniform that
+// depends on it already worked out. Matrices are stored by column, so that
+// they need no particular alignment in a std::vector.
+struct DrawCommand {
+  fplbase::Mesh* mesh;
+  fplbase::Shader* shader;
+  mathfu::vec4_packed model_view_projection[4];
+  mathfu::AffineTransform world_transform;
+  // The camera and light positions, in the mesh's object space.
+  mathfu::vec3_packed camera_position;
+  mathfu::vec3_packed light_position;
+  mathfu::vec4_packed color;
+  // As in ShadowCasterSnapshot.
+  int first_bone;
+  int num_bones;
+  // Squared distance from the camera, which the passes are sorted by.
+  float depth;
+};
+
+// The world as RenderPrep left it: everything the render thread needs to
+// draw it. The render thread reads nothing else from the world while it draws
+// the snapshot, so it can do so while the update thread works on the next
+// frame.
+struct RenderSnapshot {
+  RenderSnapshot();
+
+  // Empty the snapshot, keeping the memory it has already allocated.
+  void Clear();
+
+  // One more than the sequence of the snapshot published before this one,
+  // starting from one. Zero until the snapshot is first published.
+  unsigned int sequence;
+
+  // The camera the world is viewed from. In Cardboard, each eye is offset
+  // from it when the snapshot is drawn.
+  Camera camera;
+  bool stereoscopic;
+
+  // One bit for each ShaderDefines option that is enabled. The shaders are
+  // rebuilt whenever `shader_defines_version` changes.
+  unsigned int shader_defines;
+  unsigned int shader_defines_version;
+  bool ShaderDefineEnabled(int shader_define) const {
+    return (shader_defines & (1u << shader_define)) != 0;
+  }
+
+  // Uniforms for the shaders lit by the main light.
+  mathfu::vec4 ambient_material;
+  mathfu::vec4 diffuse_material;
+  mathfu::vec4 specular_material;
+  float shininess;
+  float shadow_intensity;
+
+  // Uniforms for the water shaders.
+  float river_offset;
+  float texture_repeats;
+
+  bool skip_rendermesh_rendering;
+
+  std::vector<DrawCommand> draw_commands[corgi::RenderPass_Count];
+
+  int num_shadow_cascades;
+  mathfu::mat4 light_view_projections[kMaxShadowCascades];
+  // Distance from the camera at which each cascade ends.
+  float shadow_cascade_splits[kMaxShadowCascades];
+  // Changes each time the static shadow layer needs to be redrawn.
+  unsigned int static_shadow_version;
+  std::vector<ShadowCasterSnapshot> static_shadow_casters[kMaxShadowCascades];
+  std::vector<ShadowCasterSnapshot> dynamic_shadow_casters[kMaxShadowCascades];
+  std::vector<mathfu::AffineTransform> bones;
+  std::vector<Render3dTextSnapshot> texts;
+};
+
+// Passes snapshots from the thread that takes them to the thread that draws
+// them, without the buffer making either wait for the other. There are three
+// snapshots: the one being written, the one being drawn, and the newest one
+// that's ready, which the writer and reader swap theirs with.
+class RenderSnapshotBuffer {
+ public:
+  RenderSnapshotBuffer();
+  ~RenderSnapshotBuffer();
+
+  // The snapshot to fill in. Only the writing thread may call this.
+  RenderSnapshot* write_snapshot() { return &snapshots_[write_index_]; }
+
+  // Make the snapshot returned by write_snapshot the newest one, and move on
+  // to writing another.
+  void Publish();
+
+  // Take the newest published snapshot, or keep the last one if nothing has
+  // been published since. Only the reading thread may call this, and the
+  // snapshot stays valid until it calls it again. Also deletes the retired
+  // meshes that the snapshot, and so every later one, no longer refers to.
+  const RenderSnapshot* Acquire();
+
+  // Delete `mesh` on the reading thread, once it has a snapshot published
+  // after this call. Only the writing thread may call this, once nothing in
+  // the world refers to the mesh any more, and before it takes the next
+  // snapshot. Snapshots that are already published may still be drawing it.
+  void RetireMesh(fplbase::Mesh* mesh);
+
+ private:
+  struct RetiredMesh {
+    fplbase::Mesh* mesh;
+    // The first snapshot that can't refer to the mesh.
+    unsigned int sequence;
+  };
+
+  RenderSnapshotBuffer(const RenderSnapshotBuffer&);
+  RenderSnapshotBuffer& operator=(const RenderSnapshotBuffer&);
+
+  RenderSnapshot snapshots_[3];
+  int write_index_;
+  int read_index_;
+  // Index of the ready snapshot, with kFreshBit set if it hasn't been
+  // acquired yet.
+  SDL_atomic_t ready_;
+  // The sequence of the last snapshot published. Only used by the writer.
+  unsigned int published_;
+  // Guards `retired_meshes_`, which both threads use.
+  SDL_mutex* retired_mutex_;
+  std::vector<RetiredMesh> retired_meshes_;
+};
+
+}  // zooshi
+}  // fpl
+
+#endif  // ZOOSHI_RENDER_SNAPSHOT_H_
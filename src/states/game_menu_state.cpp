@@ -142,6 +142,7 @@ void GameMenuState::Initialize(
 
 void GameMenuState::AdvanceFrame(int delta_time, int *next_state) {
   world_->entity_manager.UpdateComponents(delta_time);
+  world_->level_streamer.Update(world_);
   UpdateMainCamera(&main_camera_, world_);
 
   if (rewarded_video_state_ == kRewardedVideoStateDisplaying) {
@@ -240,22 +241,24 @@ void GameMenuState::AdvanceFrame(int delta_time, int *next_state) {
 }
 
 void GameMenuState::RenderPrep() {
+  SetViewportResolution(&main_camera_, world_);
   world_->world_renderer->RenderPrep(main_camera_, world_);
 }
 
 void GameMenuState::Render(fplbase::Renderer *renderer) {
-  // Ensure assets are instantiated after they've been loaded.
-  // This must be called from the render thread.
-  loading_complete_ = asset_manager_->TryFinalize();
-
   Camera *cardboard_camera = nullptr;
 #if FPLBASE_ANDROID_VR
   cardboard_camera = &cardboard_camera_;
 #endif
-  RenderWorld(*renderer, world_, main_camera_, cardboard_camera, input_system_);
+  RenderWorld(*renderer, world_, cardboard_camera, input_system_);
 }
 
 void GameMenuState::HandleUI(fplbase::Renderer *renderer) {
+  // Ensure assets are instantiated after they've been loaded.
+  // This must be called from the render thread, while the update thread,
+  // which looks the assets up, is paused.
+  loading_complete_ = asset_manager_->TryFinalize();
+
   // Don't show game menu until everything has finished loading.
   if (!loading_complete_) {
     return;
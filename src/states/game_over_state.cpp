@@ -82,6 +82,7 @@ void GameOverState::Initialize(fplbase::InputSystem* input_system, World* world,
 
 void GameOverState::AdvanceFrame(int delta_time, int* next_state) {
   world_->entity_manager.UpdateComponents(delta_time);
+  world_->level_streamer.Update(world_);
   UpdateMainCamera(&main_camera_, world_);
 
   // Return to the title screen after any key is hit.
@@ -113,6 +114,7 @@ void GameOverState::AdvanceFrame(int delta_time, int* next_state) {
 }
 
 void GameOverState::RenderPrep() {
+  SetViewportResolution(&main_camera_, world_);
   world_->world_renderer->RenderPrep(main_camera_, world_);
 }
 
@@ -121,7 +123,7 @@ void GameOverState::Render(fplbase::Renderer* renderer) {
 #if FPLBASE_ANDROID_VR
   cardboard_camera = &cardboard_camera_;
 #endif
-  RenderWorld(*renderer, world_, main_camera_, cardboard_camera, input_system_);
+  RenderWorld(*renderer, world_, cardboard_camera, input_system_);
 }
 
 void GameOverState::OnEnter(int /*previous_state*/) {
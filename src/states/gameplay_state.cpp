@@ -92,6 +92,8 @@ static void UpdateMusic(corgi::EntityManager* entity_manager, int* previous_lap,
 void GameplayState::AdvanceFrame(int delta_time, int* next_state) {
   // Update the world.
   world_->entity_manager.UpdateComponents(delta_time);
+  // Stream scenery in and out around where the raft has moved to.
+  world_->level_streamer.Update(world_);
   UpdateMainCamera(&main_camera_, world_);
   UpdateMusic(&world_->entity_manager, &previous_lap_, &percent_, delta_time,
               &music_channel_lap_1_, &music_channel_lap_2_,
@@ -133,6 +135,7 @@ void GameplayState::AdvanceFrame(int delta_time, int* next_state) {
 }
 
 void GameplayState::RenderPrep() {
+  SetViewportResolution(&main_camera_, world_);
   world_->world_renderer->RenderPrep(main_camera_, world_);
 }
 
@@ -142,15 +145,17 @@ void GameplayState::Render(fplbase::Renderer* renderer) {
 #if FPLBASE_ANDROID_VR
   cardboard_camera = &cardboard_camera_;
 #endif
-  RenderWorld(*renderer, world_, main_camera_, cardboard_camera, input_system_);
+  RenderWorld(*renderer, world_, cardboard_camera, input_system_);
+}
+
+void GameplayState::HandleUI(fplbase::Renderer* renderer) {
+  // The fader is started by AdvanceFrame, so it's drawn here, where the
+  // update thread is paused.
   if (!fader_->Finished()) {
     renderer->set_model_view_projection(
         mathfu::mat4::Ortho(-1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f));
     fader_->Render(renderer);
   }
-}
-
-void GameplayState::HandleUI(fplbase::Renderer* renderer) {
   ServicesComponent& services = world_->services_component;
   world_->onscreen_controller_ui.Update(services.asset_manager(),
                                         services.font_manager(),
@@ -211,13 +216,9 @@ void GameplayState::OnEnter(int previous_state) {
         audio_engine_->PlaySound(music_gameplay_lap_3_, mathfu::kZeros3f, 0.0f);
   }
 
-  if (world_->rendering_mode() == kRenderingStereoscopic) {
-#if FPLBASE_ANDROID_VR
-    world_->services_component.set_camera(&cardboard_camera_);
-#endif
-  } else {
-    world_->services_component.set_camera(&main_camera_);
-  }
+  // The Cardboard camera is set up for each eye on the render thread while
+  // the update runs, so the update only ever sees the main camera.
+  world_->services_component.set_camera(&main_camera_);
 #if FPLBASE_ANDROID_VR
   input_system_->head_mounted_display_input().ResetHeadTracker();
 #endif  // FPLBASE_ANDROID_VR
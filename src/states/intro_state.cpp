@@ -65,6 +65,7 @@ void IntroState::SetBoxVisibility(bool visibility) {
 void IntroState::AdvanceFrame(int delta_time, int* next_state) {
   // Update components so that the player can throw sushi.
   world_->entity_manager.UpdateComponents(delta_time);
+  world_->level_streamer.Update(world_);
   // Update camera so that the player can look around.
   UpdateMainCamera(&main_camera_, world_);
 
@@ -106,6 +107,7 @@ void IntroState::AdvanceFrame(int delta_time, int* next_state) {
 }
 
 void IntroState::RenderPrep() {
+  SetViewportResolution(&main_camera_, world_);
   world_->world_renderer->RenderPrep(main_camera_, world_);
 }
 
@@ -114,7 +116,12 @@ void IntroState::Render(fplbase::Renderer* renderer) {
 #if FPLBASE_ANDROID_VR
   cardboard_camera = &cardboard_camera_;
 #endif  // FPLBASE_ANDROID_VR
-  RenderWorld(*renderer, world_, main_camera_, cardboard_camera, input_system_);
+  RenderWorld(*renderer, world_, cardboard_camera, input_system_);
+}
+
+void IntroState::HandleUI(fplbase::Renderer* renderer) {
+  // The fader is started by AdvanceFrame, so it's drawn here, where the
+  // update thread is paused.
   if (!fader_->Finished()) {
     renderer->set_model_view_projection(
           mat4::Ortho(-1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f));
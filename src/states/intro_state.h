@@ -44,6 +44,7 @@ public:
   virtual void AdvanceFrame(int delta_time, int* next_state);
   virtual void RenderPrep();
   virtual void Render(fplbase::Renderer* renderer);
+  virtual void HandleUI(fplbase::Renderer* renderer);
   virtual void OnEnter(int previous_state);
   virtual void OnExit(int next_state);
 
@@ -99,9 +99,10 @@ void LoadingState::AdvanceFrame(int delta_time, int* next_state) {
 
 }
 
-void LoadingState::Render(fplbase::Renderer* renderer) {
+void LoadingState::HandleUI(fplbase::Renderer* renderer) {
   // Ensure assets are instantiated after they've been loaded.
-  // This must be called from the render thread.
+  // This must be called from the render thread, while the update thread,
+  // which waits on them, is paused.
   loading_complete_ =
       asset_manager_->TryFinalize() && audio_engine_->TryFinalize();
 
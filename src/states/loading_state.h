@@ -48,7 +48,10 @@ class LoadingState : public StateNode {
                   pindrop::AudioEngine* audio_engine,
                   fplbase::Shader* shader_textured, FullScreenFader* fader);
   virtual void AdvanceFrame(int delta_time, int* next_state);
-  virtual void Render(fplbase::Renderer* renderer);
+  // There's no world to draw yet. The loading screen is drawn by HandleUI,
+  // since it finalizes the assets and starts the fader.
+  virtual void Render(fplbase::Renderer* /*renderer*/) {}
+  virtual void HandleUI(fplbase::Renderer* renderer);
   virtual void OnEnter(int previous_state);
 
  protected:
@@ -121,6 +121,7 @@ GameState PauseState::PauseMenu(fplbase::AssetManager &assetman,
 }
 
 void PauseState::RenderPrep() {
+  SetViewportResolution(&main_camera_, world_);
   world_->world_renderer->RenderPrep(main_camera_, world_);
 }
 
@@ -129,7 +130,7 @@ void PauseState::Render(fplbase::Renderer *renderer) {
 #if FPLBASE_ANDROID_VR
   cardboard_camera = &cardboard_camera_;
 #endif
-  RenderWorld(*renderer, world_, main_camera_, cardboard_camera, input_system_);
+  RenderWorld(*renderer, world_, cardboard_camera, input_system_);
 }
 
 void PauseState::HandleUI(fplbase::Renderer *renderer) {
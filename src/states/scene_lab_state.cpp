@@ -73,26 +73,31 @@ void SceneLabState::AdvanceFrame(corgi::WorldTime delta_time, int* next_state) {
 }
 
 void SceneLabState::RenderPrep() {
+  camera_->set_viewport_resolution(vec2(renderer_->window_size()));
   const corgi::CameraInterface* camera = corgi_adapter_->GetCorgiCamera();
+  // Anything can be moved in the editor, so nothing counts as static.
+  world_->world_renderer->InvalidateStaticShadows();
   world_->world_renderer->RenderPrep(*camera, world_);
 }
 
 void SceneLabState::Render(fplbase::Renderer* renderer) {
-  camera_->set_viewport_resolution(vec2(renderer->window_size()));
+  world_->river_component.UploadRiverMeshes();
+  world_->world_renderer->AcquireSnapshot();
 
-  const auto camera = corgi_adapter_->GetCorgiCamera();
+  // The editor's camera moves on the update thread, so draw from the copy
+  // in the snapshot.
+  const RenderSnapshot& snapshot = world_->world_renderer->snapshot();
+  const Camera& camera = snapshot.camera;
 
-  mat4 camera_transform = camera->GetTransformMatrix();
+  mat4 camera_transform = camera.GetTransformMatrix();
   renderer->set_color(mathfu::kOnes4f);
   renderer->SetDepthFunction(fplbase::kDepthFunctionLess);
   renderer->set_model_view_projection(camera_transform);
 
-  world_->river_component.UpdateRiverMeshes();
-
-  if (world_->RenderingOptionEnabled(kShadowEffect)) {
-    world_->world_renderer->RenderShadowMap(*camera, *renderer, world_);
+  if (snapshot.ShaderDefineEnabled(kShadowEffect)) {
+    world_->world_renderer->RenderShadowMap(*renderer, world_);
   }
-  world_->world_renderer->RenderWorld(*camera, *renderer, world_);
+  world_->world_renderer->RenderWorld(camera, *renderer, world_);
 }
 
 void SceneLabState::HandleUI(fplbase::Renderer* renderer) {
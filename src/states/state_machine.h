@@ -96,6 +96,11 @@ class StateMachine {
 
   StateId current_state_id() { return current_state_id_; }
 
+  // The current state, or nullptr if the state machine is done.
+  StateNode* current_state() {
+    return valid_id(current_state_id_) ? states_[current_state_id_] : nullptr;
+  }
+
   // The state machine reaches a terminal state when it's state is less than 0
   // or greater than the number of declared states (i.e. state_count_)
   bool done() { return !valid_id(current_state_id_); }
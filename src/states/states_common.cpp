@@ -56,12 +56,12 @@ static void RenderSettingsGear(fplbase::Renderer& renderer, World* world) {
 #endif  // FPLBASE_ANDROID_VR
 
 static void RenderStereoscopic(fplbase::Renderer& renderer, World* world,
-                               Camera& camera, Camera* cardboard_camera,
+                               const Camera& camera, Camera* cardboard_camera,
                                fplbase::InputSystem* input_system) {
 #if FPLBASE_ANDROID_VR
   // Render shadow map before undistortion occurs.
-  if (world->RenderingOptionEnabled(kShadowEffect)) {
-    world->world_renderer->RenderShadowMap(camera, renderer, world);
+  if (world->world_renderer->snapshot().ShaderDefineEnabled(kShadowEffect)) {
+    world->world_renderer->RenderShadowMap(renderer, world);
   }
   fplbase::HeadMountedDisplayViewSettings view_settings;
   HeadMountedDisplayRenderStart(input_system->head_mounted_display_input(),
@@ -76,6 +76,7 @@ static void RenderStereoscopic(fplbase::Renderer& renderer, World* world,
 
   cardboard_camera->set_facing(camera.facing());
   cardboard_camera->set_up(camera.up());
+  cardboard_camera->set_viewport_resolution(camera.viewport_resolution());
 
   // Set up stereoscopic rendering parameters.
   cardboard_camera->set_stereo(true);
@@ -99,16 +100,21 @@ static void RenderStereoscopic(fplbase::Renderer& renderer, World* world,
 #endif  // FPLBASE_ANDROID_VR
 }
 
-void RenderWorld(fplbase::Renderer& renderer, World* world, Camera& camera,
-                 Camera* cardboard_camera, fplbase::InputSystem* input_system) {
-  vec2 window_size = vec2(renderer.window_size());
-  world->river_component.UpdateRiverMeshes();
+void SetViewportResolution(Camera* camera, World* world) {
+  vec2 window_size = vec2(world->asset_manager->renderer().window_size());
   if (world->rendering_mode() == kRenderingStereoscopic) {
     window_size.x = window_size.x / 2;
-    cardboard_camera->set_viewport_resolution(window_size);
   }
-  camera.set_viewport_resolution(window_size);
-  if (world->rendering_mode() == kRenderingStereoscopic) {
+  camera->set_viewport_resolution(window_size);
+}
+
+void RenderWorld(fplbase::Renderer& renderer, World* world,
+                 Camera* cardboard_camera, fplbase::InputSystem* input_system) {
+  world->river_component.UploadRiverMeshes();
+  world->world_renderer->AcquireSnapshot();
+  const RenderSnapshot& snapshot = world->world_renderer->snapshot();
+  const Camera& camera = snapshot.camera;
+  if (snapshot.stereoscopic) {
     // This takes care of setting/clearing the framebuffer for us.
     RenderStereoscopic(renderer, world, camera, cardboard_camera, input_system);
   } else {
@@ -117,10 +123,17 @@ void RenderWorld(fplbase::Renderer& renderer, World* world, Camera& camera,
     // http://www.seas.upenn.edu/~pcozzi/OpenGLInsights/OpenGLInsights-TileBasedArchitectures.pdf
     renderer.ClearFrameBuffer(mathfu::kZeros4f);
 
-    if (world->RenderingOptionEnabled(kShadowEffect)) {
-      world->world_renderer->RenderShadowMap(camera, renderer, world);
+    if (snapshot.ShaderDefineEnabled(kShadowEffect)) {
+      world->world_renderer->RenderShadowMap(renderer, world);
     }
+    // The world may be rendered at a lower resolution, and stretched over
+    // the screen before the UI is drawn on top.
+    DynamicResolution& dynamic_resolution =
+        world->world_renderer->dynamic_resolution();
+    dynamic_resolution.BeginScene(renderer);
     world->world_renderer->RenderWorld(camera, renderer, world);
+    dynamic_resolution.EndScene(
+        renderer, world->asset_manager->LoadShader("shaders/textured"));
   }
 }
 
@@ -26,8 +26,14 @@ namespace zooshi {
 // Update the camera to the location of the player in the given world.
 void UpdateMainCamera(Camera* camera, World* world);
 
-// Render the world monoscopically or stereoscopically.
-void RenderWorld(fplbase::Renderer& renderer, World* world, Camera& camera,
+// Fit the camera's view to the window, or to one eye's half of it in
+// Cardboard. Call this on the update thread, before taking the snapshot.
+void SetViewportResolution(Camera* camera, World* world);
+
+// Render the newest snapshot of the world monoscopically or stereoscopically,
+// from the camera it was taken with. This doesn't need the update thread to
+// be paused.
+void RenderWorld(fplbase::Renderer& renderer, World* world,
                  Camera* cardboard_camera, fplbase::InputSystem* input_system);
 
 }  // zooshi
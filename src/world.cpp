@@ -14,6 +14,7 @@
 
 #include "world.h"
 
+#include <set>
 #include "breadboard/graph_factory.h"
 #include "components_generated.h"
 #include "config_generated.h"
@@ -56,6 +57,15 @@ static const char kEntityLibraryFile[] = "entity_prototypes.zooentity";
 static const char kComponentDefBinarySchema[] =
     "flatbufferschemas/components.bfbs";
 
+template <typename T>
+void World::RegisterComponent(T* component, unsigned int data_type,
+                              const char* table_name) {
+  const corgi::ComponentId component_id =
+      entity_manager.RegisterComponent(component);
+  entity_factory->SetComponentType(component_id, data_type, table_name);
+  prototype_cache.SetComponentType(component_id, data_type);
+}
+
 void World::Initialize(
     const Config& config_, fplbase::InputSystem* input_system,
     fplbase::AssetManager* asset_mgr, WorldRenderer* worldrenderer,
@@ -89,82 +99,62 @@ void World::Initialize(
                                 audio_engine, font_manager, &rail_manager,
                                 entity_factory.get(), this, scene_lab);
 
-  entity_factory->SetComponentType(
-      entity_manager.RegisterComponent(&common_services_component),
-      ComponentDataUnion_ServicesDef, "corgi.CommonServicesDef");
-  entity_factory->SetComponentType(
-      entity_manager.RegisterComponent(&services_component),
-      ComponentDataUnion_ServicesDef, "corgi.ServicesDef");
-  entity_factory->SetComponentType(
-      entity_manager.RegisterComponent(&graph_component),
-      ComponentDataUnion_corgi_GraphDef, "corgi.GraphDef");
-  entity_factory->SetComponentType(
-      entity_manager.RegisterComponent(&attributes_component),
-      ComponentDataUnion_AttributesDef, "fpl.AttributesDef");
-  entity_factory->SetComponentType(
-      entity_manager.RegisterComponent(&rail_denizen_component),
-      ComponentDataUnion_RailDenizenDef, "fpl.RailDenizenDef");
-  entity_factory->SetComponentType(
-      entity_manager.RegisterComponent(&simple_movement_component),
-      ComponentDataUnion_SimpleMovementDef, "fpl.SimpleMovementDef");
-  entity_factory->SetComponentType(
-      entity_manager.RegisterComponent(&lap_dependent_component),
-      ComponentDataUnion_LapDependentDef, "fpl.LapDependentDef");
-  entity_factory->SetComponentType(
-      entity_manager.RegisterComponent(&player_component),
-      ComponentDataUnion_PlayerDef, "fpl.PlayerDef");
-  entity_factory->SetComponentType(
-      entity_manager.RegisterComponent(&player_projectile_component),
-      ComponentDataUnion_PlayerProjectileDef, "fpl.PlayerProjectileDef");
-  entity_factory->SetComponentType(
-      entity_manager.RegisterComponent(&render_mesh_component),
-      ComponentDataUnion_corgi_RenderMeshDef, "corgi.RenderMeshDef");
-  entity_factory->SetComponentType(
-      entity_manager.RegisterComponent(&physics_component),
-      ComponentDataUnion_corgi_PhysicsDef, "corgi.PhysicsDef");
-  entity_factory->SetComponentType(
-      entity_manager.RegisterComponent(&patron_component),
-      ComponentDataUnion_PatronDef, "fpl.PatronDef");
-  entity_factory->SetComponentType(
-      entity_manager.RegisterComponent(&time_limit_component),
-      ComponentDataUnion_TimeLimitDef, "fpl.TimeLimitDef");
-  entity_factory->SetComponentType(
-      entity_manager.RegisterComponent(&audio_listener_component),
-      ComponentDataUnion_ListenerDef, "fpl.ListenerDef");
-  entity_factory->SetComponentType(
-      entity_manager.RegisterComponent(&sound_component),
-      ComponentDataUnion_SoundDef, "fpl.SoundDef");
-  entity_factory->SetComponentType(
-      entity_manager.RegisterComponent(&river_component),
-      ComponentDataUnion_RiverDef, "fpl.RiverDef");
-  entity_factory->SetComponentType(
-      entity_manager.RegisterComponent(&shadow_controller_component),
-      ComponentDataUnion_ShadowControllerDef, "fpl.ShadowControllerDef");
-  entity_factory->SetComponentType(
-      entity_manager.RegisterComponent(&meta_component),
-      ComponentDataUnion_corgi_MetaDef, "corgi.MetaDef");
-  entity_factory->SetComponentType(
-      entity_manager.RegisterComponent(&edit_options_component),
-      ComponentDataUnion_scene_lab_EditOptionsDef, "scene_lab.EditOptionsDef");
-  entity_factory->SetComponentType(
-      entity_manager.RegisterComponent(&scenery_component),
-      ComponentDataUnion_SceneryDef, "fpl.SceneryDef");
-  entity_factory->SetComponentType(
-      entity_manager.RegisterComponent(&animation_component),
-      ComponentDataUnion_corgi_AnimationDef, "corgi.AnimationDef");
-  entity_factory->SetComponentType(
-      entity_manager.RegisterComponent(&rail_node_component),
-      ComponentDataUnion_RailNodeDef, "fpl.RailNodeDef");
-  entity_factory->SetComponentType(
-      entity_manager.RegisterComponent(&render_3d_text_component),
-      ComponentDataUnion_Render3dTextDef, "fpl.Render3dTextDef");
-  entity_factory->SetComponentType(
-      entity_manager.RegisterComponent(&light_component),
-      ComponentDataUnion_LightDef, "fpl.LightDef");
+  RegisterComponent(&common_services_component, ComponentDataUnion_ServicesDef,
+                    "corgi.CommonServicesDef");
+  RegisterComponent(&services_component, ComponentDataUnion_ServicesDef,
+                    "corgi.ServicesDef");
+  RegisterComponent(&graph_component, ComponentDataUnion_corgi_GraphDef,
+                    "corgi.GraphDef");
+  RegisterComponent(&attributes_component, ComponentDataUnion_AttributesDef,
+                    "fpl.AttributesDef");
+  RegisterComponent(&rail_denizen_component, ComponentDataUnion_RailDenizenDef,
+                    "fpl.RailDenizenDef");
+  RegisterComponent(&simple_movement_component,
+                    ComponentDataUnion_SimpleMovementDef,
+                    "fpl.SimpleMovementDef");
+  RegisterComponent(&lap_dependent_component,
+                    ComponentDataUnion_LapDependentDef, "fpl.LapDependentDef");
+  RegisterComponent(&player_component, ComponentDataUnion_PlayerDef,
+                    "fpl.PlayerDef");
+  RegisterComponent(&player_projectile_component,
+                    ComponentDataUnion_PlayerProjectileDef,
+                    "fpl.PlayerProjectileDef");
+  RegisterComponent(&render_mesh_component,
+                    ComponentDataUnion_corgi_RenderMeshDef,
+                    "corgi.RenderMeshDef");
+  RegisterComponent(&physics_component, ComponentDataUnion_corgi_PhysicsDef,
+                    "corgi.PhysicsDef");
+  RegisterComponent(&patron_component, ComponentDataUnion_PatronDef,
+                    "fpl.PatronDef");
+  RegisterComponent(&time_limit_component, ComponentDataUnion_TimeLimitDef,
+                    "fpl.TimeLimitDef");
+  RegisterComponent(&audio_listener_component, ComponentDataUnion_ListenerDef,
+                    "fpl.ListenerDef");
+  RegisterComponent(&sound_component, ComponentDataUnion_SoundDef,
+                    "fpl.SoundDef");
+  RegisterComponent(&river_component, ComponentDataUnion_RiverDef,
+                    "fpl.RiverDef");
+  RegisterComponent(&shadow_controller_component,
+                    ComponentDataUnion_ShadowControllerDef,
+                    "fpl.ShadowControllerDef");
+  RegisterComponent(&meta_component, ComponentDataUnion_corgi_MetaDef,
+                    "corgi.MetaDef");
+  RegisterComponent(&edit_options_component,
+                    ComponentDataUnion_scene_lab_EditOptionsDef,
+                    "scene_lab.EditOptionsDef");
+  RegisterComponent(&scenery_component, ComponentDataUnion_SceneryDef,
+                    "fpl.SceneryDef");
+  RegisterComponent(&animation_component, ComponentDataUnion_corgi_AnimationDef,
+                    "corgi.AnimationDef");
+  RegisterComponent(&rail_node_component, ComponentDataUnion_RailNodeDef,
+                    "fpl.RailNodeDef");
+  RegisterComponent(&render_3d_text_component,
+                    ComponentDataUnion_Render3dTextDef, "fpl.Render3dTextDef");
+  RegisterComponent(&light_component, ComponentDataUnion_LightDef,
+                    "fpl.LightDef");
   // Make sure you register TransformComponent after any components that use it.
-  entity_factory->SetComponentType(
-      entity_manager.RegisterComponent(&transform_component),
-      ComponentDataUnion_corgi_TransformDef, "corgi.TransformDef");
+  RegisterComponent(&transform_component, ComponentDataUnion_corgi_TransformDef,
+                    "corgi.TransformDef");
 
   physics_component.set_collision_callback(&PatronComponent::CollisionHandler,
                                            &patron_component);
@@ -174,6 +164,12 @@ void World::Initialize(
   entity_factory->SetFlatbufferSchema(kComponentDefBinarySchema);
   entity_factory->AddEntityLibrary(kEntityLibraryFile);
 
+  // The prototype cache points into the library, so it stays loaded.
+  prototype_library_.reset(new EntityFile(kEntityLibraryFile));
+  if (prototype_library_->Load()) {
+    prototype_cache.AddLibrary(GetEntityListDef(prototype_library_->data()));
+  }
+
   entity_manager.set_entity_factory(entity_factory.get());
 
   render_mesh_component.set_light_position(vec3(-10, -20, 20));
@@ -197,6 +193,20 @@ void World::Initialize(
   rendering_options_[kRenderingStereoscopic][kSpecularEffect] =
       config->rendering_config()->apply_specular_by_default_cardboard();
 
+  // Props can be moved in the editor, so the visible sets are only valid
+  // outside of it. The editor also saves every entity back to its file, so
+  // every prop has to be loaded while it's open.
+  if (scene_lab) {
+    scene_lab->AddOnEnterEditorCallback([this]() {
+      rail_visibility.Reset(this);
+      level_streamer.LoadAll(this);
+    });
+    scene_lab->AddOnExitEditorCallback([this]() {
+      level_streamer.Partition(this);
+      rail_visibility.Bake(this);
+    });
+  }
+
   invites_listener = invites_lstr;
   message_listener = message_lstr;
   admob_helper = admob_hlpr;
@@ -274,25 +284,78 @@ bool World::RenderingOptionEnabled(RenderingMode rendering_mode,
 }
 
 void LoadWorldDef(World* world, const WorldDef* world_def) {
+  // The visible sets are of the entities about to be deleted.
+  world->rail_visibility.Reset(world);
   for (auto iter = world->entity_manager.begin();
        iter != world->entity_manager.end(); ++iter) {
     world->entity_manager.DeleteEntity(iter.ToReference());
   }
   world->entity_manager.DeleteMarkedEntities();
   assert(world->entity_manager.begin() == world->entity_manager.end());
+
+  const LevelDef* level_def = world_def->levels()->Get(
+    static_cast<flatbuffers::uoffset_t>(world->level_index));
+  world->level_streamer.Reset(level_def->streaming());
+
+  // The world's entity files, followed by the level's.
+  std::vector<const char*> filenames;
   for (size_t i = 0; i < world_def->entity_files()->size(); i++) {
     flatbuffers::uoffset_t index = static_cast<flatbuffers::uoffset_t>(i);
-    const char* filename = world_def->entity_files()->Get(index)->c_str();
-    world->entity_factory->LoadEntitiesFromFile(filename,
-                                                &world->entity_manager);
+    filenames.push_back(world_def->entity_files()->Get(index)->c_str());
   }
-  const LevelDef* level_def = world_def->levels()->Get(
-    static_cast<flatbuffers::uoffset_t>(world->level_index));
   for (size_t i = 0; i < level_def->entity_files()->size(); i++) {
-    const char* filename = level_def->entity_files()->Get(
-      static_cast<flatbuffers::uoffset_t>(i))->c_str();
-    world->entity_factory->LoadEntitiesFromFile(filename,
-                                                &world->entity_manager);
+    filenames.push_back(level_def->entity_files()->Get(
+      static_cast<flatbuffers::uoffset_t>(i))->c_str());
+  }
+
+  // Release the files that only the previous level's entities used.
+  std::set<std::string> used_files(filenames.begin(), filenames.end());
+  for (auto file = world->loaded_entity_files_.begin();
+       file != world->loaded_entity_files_.end();) {
+    if (used_files.count(file->first) == 0) {
+      file = world->loaded_entity_files_.erase(file);
+    } else {
+      ++file;
+    }
+  }
+
+  // Map and verify all the files that aren't loaded yet in parallel. Only
+  // then create their entities, one file at a time in the order listed, so
+  // that the entities are created in the same order every time.
+  std::vector<std::unique_ptr<EntityFile>> files;
+  for (auto filename = used_files.begin(); filename != used_files.end();
+       ++filename) {
+    if (world->loaded_entity_files_.find(*filename) ==
+        world->loaded_entity_files_.end()) {
+      files.push_back(std::unique_ptr<EntityFile>(new EntityFile(*filename)));
+    }
+  }
+  ReadEntityFiles(&files);
+  for (auto file = files.begin(); file != files.end(); ++file) {
+    if ((*file)->valid()) {
+      const std::string& filename = (*file)->filename();
+      world->loaded_entity_files_[filename] = std::move(*file);
+    }
+  }
+
+  for (auto filename = filenames.begin(); filename != filenames.end();
+       ++filename) {
+    auto file = world->loaded_entity_files_.find(*filename);
+    if (file == world->loaded_entity_files_.end()) continue;
+    // Entities based on prototypes are created from the prototypes'
+    // cached blueprints.
+    auto entity_list = GetEntityListDef(file->second->data())->entity_list();
+    for (auto entity_def = entity_list->begin();
+         entity_def != entity_list->end(); ++entity_def) {
+      // Props that are streamed in later are left to the level streamer.
+      if (world->level_streamer.AddEntity(world, *entity_def, *filename)) {
+        continue;
+      }
+      corgi::EntityRef entity = world->prototype_cache.CreateEntity(
+          *entity_def, &world->entity_manager);
+      // Scene Lab saves entities back to the file they came from.
+      world->meta_component.AddEntity(entity)->source_file = *filename;
+    }
   }
 
   world->SetActiveController(kControllerDefault);
@@ -311,6 +374,10 @@ void LoadWorldDef(World* world, const WorldDef* world_def) {
   world->services_component.set_raft_entity(raft_entity);
 
   world->graph_component.PostLoadFixup();
+
+  world->level_streamer.Partition(world);
+  world->rail_visibility.Bake(world);
+  world->world_renderer->InvalidateStaticShadows();
 }
 
 }  // zooshi
@@ -47,6 +47,7 @@
 #include "corgi_component_library/physics.h"
 #include "corgi_component_library/rendermesh.h"
 #include "corgi_component_library/transform.h"
+#include "entity_file_loader.h"
 
 #include "mathfu/internal/disable_warnings_begin.h"
 
@@ -60,7 +61,10 @@
 #include "inputcontrollers/gamepad_controller.h"
 #include "inputcontrollers/onscreen_controller.h"
 #include "invites.h"
+#include "level_streamer.h"
 #include "messaging.h"
+#include "prototype_cache.h"
+#include "rail_visibility.h"
 #include "railmanager.h"
 #include "scene_lab/corgi/corgi_adapter.h"
 #include "scene_lab/corgi/edit_options.h"
@@ -136,9 +140,19 @@ struct World {
   // Entity factory, for creating entities from data.
   std::unique_ptr<corgi::component_library::EntityFactory> entity_factory;
 
+  // Creates entities from prototypes in the entity library, and from entity
+  // files, without resolving their prototypes every time.
+  PrototypeCache prototype_cache;
+
   // Rail Manager - manages loading and storing of rail definitions
   RailManager rail_manager;
 
+  // Per-segment visible sets of static props along the raft's rail.
+  RailVisibility rail_visibility;
+
+  // Creates and deletes the level's props as the raft moves along its rail.
+  LevelStreamer level_streamer;
+
   // Components
   corgi::component_library::TransformComponent transform_component;
   corgi::component_library::AnimationComponent animation_component;
@@ -189,10 +203,10 @@ struct World {
   MessageListener* message_listener;
   AdMobHelper* admob_helper;
 
-  // TODO: Refactor all components so they don't require their source
-  // data to remain in memory after their initial load. Then get rid of this,
-  // which keeps all entity files loaded in memory.
-  std::map<std::string, std::string> loaded_entity_files_;
+  // Components keep pointers into the data they were loaded from, so the
+  // current level's entity files stay mapped while it's loaded. LoadWorldDef
+  // releases the files the next level doesn't use.
+  std::map<std::string, std::unique_ptr<EntityFile>> loaded_entity_files_;
 
   // Determines if the debug drawing of physics should be used.
   bool draw_debug_physics;
@@ -279,6 +293,15 @@ struct World {
   size_t level_index;
 
  private:
+  // Register `component` with the entity manager, and with the entity factory
+  // and prototype cache as the component built from `data_type` definitions.
+  template <typename T>
+  void RegisterComponent(T* component, unsigned int data_type,
+                         const char* table_name);
+
+  // The entity library that `prototype_cache` points into.
+  std::unique_ptr<EntityFile> prototype_library_;
+
   // Determines if the game is in Cardboard mode (for special rendering).
   RenderingMode rendering_mode_;
 
@@ -14,11 +14,18 @@
 
 #include "world_renderer.h"
 
+#include <algorithm>
+#include <cmath>
+#include "camera.h"
+#include "components/lap_dependent.h"
 #include "components/light.h"
+#include "components/patron.h"
+#include "components/scenery.h"
 #include "components/services.h"
 #include "corgi_component_library/transform.h"
 #include "fplbase/debug_markers.h"
 #include "fplbase/flatbuffer_utils.h"
+#include "fplbase/systrace.h"
 #include "motive/math/angle.h"
 
 using mathfu::vec2i;
@@ -33,10 +40,16 @@ using motive::kDegreesToRadians;
 namespace fpl {
 namespace zooshi {
 
+using corgi::component_library::AnimationData;
 using corgi::component_library::RenderMeshComponent;
+using corgi::component_library::RenderMeshData;
 using corgi::component_library::TransformData;
 using corgi::EntityRef;
 
+// Like kShadowMapTextureID, but for the static shadow layer. Any change to
+// this constant must be mirrored in shadow_map.glslf_h texture_unit_<id>.
+static const int kStaticShadowMapTextureID = 6;
+
 // The texture ID that maps the one the shader is expecting. Any change to
 // this constant must be mirrored in shadow_map.glslf_h texture_unit_<id>.
 static const int kShadowMapTextureID = 7;
@@ -51,6 +64,15 @@ static const char *kDefinesText[] = {"PHONG_SHADING", "SPECULAR_EFFECT",
 static_assert(FPL_ARRAYSIZE(kDefinesText) == kNumShaderDefines,
               "Need to update kDefinesText");
 
+// Names of the light_view_projection uniform of each cascade.
+static const char *kLightViewProjectionUniforms[] = {
+    "light_view_projection_0", "light_view_projection_1",
+    "light_view_projection_2"};
+
+// Cascades are kept within this fraction of the light camera's distance, so
+// their view angle stays well short of 180 degrees.
+static const float kMaxShadowCascadeSize = 0.95f;
+
 const char *kEmptyString = "";
 
 void WorldRenderer::Initialize(World *world) {
@@ -58,17 +80,51 @@ void WorldRenderer::Initialize(World *world) {
       world->config->rendering_config()->shadow_map_resolution();
   shadow_map_.Initialize(
       mathfu::vec2i(shadow_map_resolution, shadow_map_resolution));
+  static_shadow_map_.Initialize(
+      mathfu::vec2i(shadow_map_resolution, shadow_map_resolution));
+  num_shadow_cascades_ = 0;
+  shadow_focus_valid_ = false;
+  static_shadow_version_ = 0;
+  drawn_static_shadow_version_ = 0;
+  shader_defines_version_ = 0;
+  built_shader_defines_version_ = 0;
+  num_skinned_bones_ = 0;
+  dynamic_resolution_.Initialize(world->config->rendering_config());
+  snapshot_ = snapshots_.Acquire();
 
   RefreshGlobalShaderDefines(world);
 }
 
+// One bit for each ShaderDefines option that `world` enables.
+static unsigned int EnabledShaderDefines(World *world) {
+  unsigned int shader_defines = 0;
+  for (int s = 0; s < kNumShaderDefines; ++s) {
+    if (world->RenderingOptionEnabled(static_cast<ShaderDefines>(s))) {
+      shader_defines |= 1u << s;
+    }
+  }
+  return shader_defines;
+}
+
 void WorldRenderer::RefreshGlobalShaderDefines(World *world) {
+  SetGlobalShaderDefines(EnabledShaderDefines(world), world);
+  world->ResetRenderingDirty();
+}
+
+void WorldRenderer::UpdateGlobalShaderDefines(World *world) {
+  if (snapshot_->shader_defines_version != built_shader_defines_version_) {
+    SetGlobalShaderDefines(snapshot_->shader_defines, world);
+    built_shader_defines_version_ = snapshot_->shader_defines_version;
+  }
+}
+
+void WorldRenderer::SetGlobalShaderDefines(unsigned int shader_defines,
+                                           World *world) {
   std::vector<std::string> defines_to_add;
   std::vector<std::string> defines_to_omit;
   for (int s = 0; s < kNumShaderDefines; ++s) {
-    ShaderDefines shader_define = static_cast<ShaderDefines>(s);
-    if (!world->RenderingOptionEnabled(shader_define)) {
-      defines_to_omit.push_back(kDefinesText[shader_define]);
+    if (!(shader_defines & (1u << s))) {
+      defines_to_omit.push_back(kDefinesText[s]);
     }
   }
 
@@ -87,20 +143,40 @@ void WorldRenderer::RefreshGlobalShaderDefines(World *world) {
   textured_shader_->ReloadIfDirty();
 
   PopDebugMarker();  // ShaderCompile
-
-  world->ResetRenderingDirty();
 }
 
-void WorldRenderer::CreateShadowMap(const corgi::CameraInterface &camera,
-                                    fplbase::Renderer &renderer, World *world) {
-  PushDebugMarker("CreateShadowMap");
+// Whether `entity` will stay exactly as it is drawn in the static shadow
+// layer: it doesn't move, animate, or get shown and hidden by gameplay.
+// Scenery counts while it is still, since SceneryComponent invalidates the
+// static layer whenever that changes.
+static bool IsStaticShadowCaster(World *world, EntityRef entity) {
+  if (!RailVisibility::IsStatic(world, entity)) return false;
+  const EntityRef caster = entity;
+  bool animated =
+      world->entity_manager.GetComponentData<AnimationData>(entity) != nullptr;
+  while (entity.IsValid()) {
+    const SceneryData *scenery_data =
+        world->entity_manager.GetComponentData<SceneryData>(entity);
+    if (scenery_data != nullptr) {
+      if (!scenery_data->still) return false;
+      // The scenery's own animation is stopped while it is still.
+      if (scenery_data->render_child == caster) animated = false;
+    }
+    if (world->entity_manager.GetComponentData<PatronData>(entity) ||
+        world->entity_manager.GetComponentData<LapDependentData>(entity)) {
+      return false;
+    }
+    const TransformData *transform_data =
+        world->entity_manager.GetComponentData<TransformData>(entity);
+    if (transform_data == nullptr) break;
+    entity = transform_data->parent;
+  }
+  return !animated;
+}
 
-  PushDebugMarker("Setup");
-  float shadow_map_resolution = static_cast<float>(
-      world->config->rendering_config()->shadow_map_resolution());
-  float shadow_map_zoom = world->config->rendering_config()->shadow_map_zoom();
-  float shadow_map_offset =
-      world->config->rendering_config()->shadow_map_offset();
+void WorldRenderer::PrepareShadowCasters(const corgi::CameraInterface &camera,
+                                         World *world) {
+  const RenderConfig *render_config = world->config->rendering_config();
   LightComponent *light_component =
       world->entity_manager.GetComponent<LightComponent>();
 
@@ -108,46 +184,492 @@ void WorldRenderer::CreateShadowMap(const corgi::CameraInterface &camera,
   const TransformData *light_transform =
       world->entity_manager.GetComponentData<TransformData>(main_light_entity);
   vec3 light_position = light_transform->position;
+
+  int num_cascades = render_config->shadow_cascade_count();
+  if (num_cascades < 1) num_cascades = 1;
+  if (num_cascades > kMaxShadowCascades) num_cascades = kMaxShadowCascades;
+  const float refresh_distance =
+      render_config->static_shadow_refresh_distance();
+  bool refresh = !shadow_focus_valid_ || num_cascades != num_shadow_cascades_ ||
+                 (light_position - light_cameras_[0].position())
+                         .LengthSquared() > 0.0f;
+
+  // Split the view out to shadow_distance into slices, blending between even
+  // and logarithmic spacing, and bound each slice with a sphere.
+  const float near_plane = std::max(camera.viewport_near_plane(), 0.01f);
+  const float far_plane =
+      std::max(render_config->shadow_distance(), near_plane);
+  const float lambda = render_config->shadow_cascade_split_lambda();
+  const float tan_half_angle = tanf(camera.viewport_angle() * 0.5f);
+  const vec2 resolution = camera.viewport_resolution();
+  const float aspect = resolution.y > 0.0f ? resolution.x / resolution.y : 1.0f;
+  vec3 centers[kMaxShadowCascades];
+  float radii[kMaxShadowCascades];
+  float split_near = near_plane;
+  for (int i = 0; i < num_cascades; ++i) {
+    const float t = static_cast<float>(i + 1) / num_cascades;
+    const float split_far =
+        lambda * near_plane * powf(far_plane / near_plane, t) +
+        (1.0f - lambda) * (near_plane + (far_plane - near_plane) * t);
+    const float half_depth = (split_far - split_near) * 0.5f;
+    const float half_height = split_far * tan_half_angle;
+    const float half_width = half_height * aspect;
+    centers[i] =
+        camera.position() + camera.facing() * (split_near + half_depth);
+    // Grow the sphere so it still holds the slice wherever the camera gets to
+    // before the cascade is next moved.
+    radii[i] = sqrtf(half_depth * half_depth + half_height * half_height +
+                     half_width * half_width) +
+               refresh_distance;
+    shadow_cascade_splits_[i] = split_far;
+    if ((centers[i] - shadow_cascade_centers_[i]).LengthSquared() >
+        refresh_distance * refresh_distance) {
+      refresh = true;
+    }
+    split_near = split_far;
+  }
+
+  // Only move the cascades once they have drifted far enough, since moving
+  // them means redrawing the static layer.
   SetLightPosition(light_position);
+  if (refresh) {
+    num_shadow_cascades_ = num_cascades;
+    shadow_focus_valid_ = true;
+    ++static_shadow_version_;
+    const float tile_resolution =
+        static_cast<float>(render_config->shadow_map_resolution() / 2);
+    for (int i = 0; i < num_cascades; ++i) {
+      shadow_cascade_centers_[i] = centers[i];
+      shadow_cascade_radii_[i] = radii[i];
+      static_shadow_casters_[i].clear();
+
+      // Aim a light camera at the cascade, just wide enough to take it in.
+      Camera &light_camera = light_cameras_[i];
+      const vec3 light_facing = centers[i] - light_position;
+      const float distance = light_facing.Length();
+      const float size = distance > 0.0f
+                             ? std::min(radii[i] / distance,
+                                        kMaxShadowCascadeSize)
+                             : kMaxShadowCascadeSize;
+      light_camera.set_viewport_angle(2.0f * asinf(size));
+      light_camera.set_viewport_resolution(
+          vec2(tile_resolution, tile_resolution));
+      if (distance > 0.0f) {
+        light_camera.set_facing(light_facing / distance);
+      }
+    }
+  }
+
+  // Collect casters separately for each cascade whose light camera they can
+  // be seen from.
+  for (int i = 0; i < kMaxShadowCascades; ++i) {
+    dynamic_shadow_casters_[i].clear();
+  }
+  for (auto iter = world->render_mesh_component.begin();
+       iter != world->render_mesh_component.end(); ++iter) {
+    const RenderMeshData *rendermesh_data = &iter->data;
+    if (!rendermesh_data->visible || rendermesh_data->pass_mask == 0 ||
+        rendermesh_data->mesh == nullptr ||
+        rendermesh_data->shaders.size() <= ShaderIndex_Depth ||
+        rendermesh_data->shaders[ShaderIndex_Depth] == nullptr) {
+      continue;
+    }
+
+    const mat4 &world_transform =
+        world->transform_component.GetComponentData(iter->entity)
+            ->world_transform;
+    const fplbase::Mesh *mesh = rendermesh_data->mesh;
+    const vec3 center = world_transform *
+                        ((mesh->min_position() + mesh->max_position()) * 0.5f);
+    float scale = 0.0f;
+    for (int i = 0; i < 3; ++i) {
+      scale = std::max(scale, world_transform.GetColumn(i).xyz().Length());
+    }
+    const float radius =
+        (mesh->max_position() - mesh->min_position()).Length() * 0.5f * scale;
+
+    // Checking whether a caster is static walks its parents, so only do it
+    // for casters that land in a cascade.
+    int is_static = -1;
+    for (int i = 0; i < num_shadow_cascades_; ++i) {
+      if (!ShadowCascadeContains(i, center, radius)) continue;
+      if (is_static < 0) {
+        is_static = IsStaticShadowCaster(world, iter->entity) ? 1 : 0;
+      }
+      if (!is_static) {
+        dynamic_shadow_casters_[i].push_back(iter->entity);
+      } else if (refresh) {
+        static_shadow_casters_[i].push_back(iter->entity);
+      }
+    }
+  }
+}
+
+bool WorldRenderer::ShadowCascadeContains(int cascade, const vec3 &center,
+                                          float radius) const {
+  const Camera &light_camera = light_cameras_[cascade];
+  const vec3 to_center = center - light_camera.position();
+  const float distance = to_center.Length();
+  if (distance <= radius) return true;
+
+  // Casters behind the light, or beyond the far side of the cascade, can't
+  // shadow anything in it.
+  const float depth = vec3::DotProduct(to_center, light_camera.facing());
+  const float cascade_far =
+      (shadow_cascade_centers_[cascade] - light_camera.position()).Length() +
+      shadow_cascade_radii_[cascade];
+  if (depth + radius < 0.0f || depth - radius > cascade_far) return false;
+
+  // Otherwise, the caster's sphere has to overlap the light camera's cone.
+  const float angle_to_center =
+      acosf(std::max(-1.0f, std::min(depth / distance, 1.0f)));
+  return angle_to_center <=
+         light_camera.viewport_angle() * 0.5f + asinf(radius / distance);
+}
+
+void WorldRenderer::CreateShadowMap(fplbase::Renderer &renderer,
+                                    World *world) {
+  PushDebugMarker("CreateShadowMap");
 
-  float viewport_angle =
-      world->config->rendering_config()->shadow_map_viewport_angle() *
-      kDegreesToRadians;
-  light_camera_.set_viewport_angle(viewport_angle / shadow_map_zoom);
-  light_camera_.set_viewport_resolution(
-      vec2(shadow_map_resolution, shadow_map_resolution));
-  vec3 light_camera_focus =
-      camera.position() + camera.facing() * shadow_map_offset;
-  light_camera_focus.z = 0;
-  vec3 light_facing = light_camera_focus - light_camera_.position();
-  light_camera_.set_facing(light_facing.Normalized());
-
-  // Shadow map needs to be cleared to near-white, since that's
-  // the maximum (furthest) depth.
-  shadow_map_.SetAsRenderTarget();
-  renderer.ClearFrameBuffer(kShadowMapClearColor);
   renderer.SetCulling(fplbase::kCullingModeBack);
 
-  depth_shader_->Set(renderer);
-  depth_skinned_shader_->Set(renderer);
-  // Generate the shadow map:
-  // TODO - modify this so that shadowcast is its own render pass
-  PopDebugMarker(); // Setup
-
-  for (int pass = 0; pass < corgi::RenderPass_Count; pass++) {
-    PushDebugMarker("RenderPass");
-    world->render_mesh_component.RenderPass(pass, light_camera_, renderer,
-                                            ShaderIndex_Depth);
-    PopDebugMarker();
+  // Shadow maps need to be cleared to near-white, since that's
+  // the maximum (furthest) depth.
+  if (snapshot_->static_shadow_version != drawn_static_shadow_version_) {
+    PushDebugMarker("StaticLayer");
+    static_shadow_map_.SetAsRenderTarget();
+    renderer.ClearFrameBuffer(kShadowMapClearColor);
+    RenderShadowCascades(snapshot_->static_shadow_casters, renderer, world);
+    drawn_static_shadow_version_ = snapshot_->static_shadow_version;
+    PopDebugMarker();  // StaticLayer
   }
 
+  PushDebugMarker("DynamicLayer");
+  shadow_map_.SetAsRenderTarget();
+  renderer.ClearFrameBuffer(kShadowMapClearColor);
+  RenderShadowCascades(snapshot_->dynamic_shadow_casters, renderer, world);
+  PopDebugMarker();  // DynamicLayer
+
   fplbase::RenderTarget::ScreenRenderTarget(renderer).SetAsRenderTarget();
   PopDebugMarker(); // CreateShadowMap
 }
 
+void WorldRenderer::RenderShadowCascades(
+    const std::vector<ShadowCasterSnapshot> *casters,
+    fplbase::Renderer &renderer, World *world) {
+  // Cascades are laid out left to right, then bottom to top, to match
+  // ApplyCascadedShadows in shadow_map.glslf_h.
+  const int tile_resolution =
+      world->config->rendering_config()->shadow_map_resolution() / 2;
+  for (int i = 0; i < snapshot_->num_shadow_cascades; ++i) {
+    glViewport((i % 2) * tile_resolution, (i / 2) * tile_resolution,
+               tile_resolution, tile_resolution);
+    RenderShadowCasters(casters[i], i, renderer);
+  }
+}
+
+void WorldRenderer::RenderShadowCasters(
+    const std::vector<ShadowCasterSnapshot> &casters, int cascade,
+    fplbase::Renderer &renderer) {
+  const mat4 &light_view_projection =
+      snapshot_->light_view_projections[cascade];
+  for (auto iter = casters.begin(); iter != casters.end(); ++iter) {
+    renderer.set_model_view_projection(
+        light_view_projection *
+        mat4::FromAffineTransform(iter->world_transform));
+    if (iter->num_bones > 0) {
+      renderer.SetAnimation(&snapshot_->bones[iter->first_bone],
+                            iter->num_bones);
+    }
+    iter->shader->Set(renderer);
+    iter->mesh->Render(renderer, true);
+  }
+}
+
+// Pose `rendermesh_data`'s skinned mesh, from the entity's animation if it
+// matches the mesh, or from the mesh's default pose, and append the pose to
+// `bones`. Returns the number of bones appended, which is zero for meshes
+// that aren't skinned.
+static int AppendPose(const EntityRef &entity,
+                      const RenderMeshData *rendermesh_data, World *world,
+                      std::vector<mathfu::AffineTransform> *bones) {
+  const fplbase::Mesh *mesh = rendermesh_data->mesh;
+  const int num_mesh_bones = static_cast<int>(mesh->num_bones());
+  if (num_mesh_bones <= 1 || rendermesh_data->shader_transforms == nullptr) {
+    return 0;
+  }
+  const AnimationData *anim_data =
+      world->entity_manager.GetComponentData<AnimationData>(entity);
+  const bool has_anim = anim_data != nullptr && anim_data->motivator.Valid() &&
+                        anim_data->motivator.DefiningAnim()->NumBones() ==
+                            num_mesh_bones;
+  const size_t first_bone = bones->size();
+  bones->resize(first_bone + rendermesh_data->num_shader_transforms);
+  mesh->GatherShaderTransforms(has_anim
+                                   ? anim_data->motivator.GlobalTransforms()
+                                   : mesh->bone_global_transforms(),
+                               &(*bones)[first_bone]);
+  return rendermesh_data->num_shader_transforms;
+}
+
+// Copy each of `casters` that still exists into `caster_snapshots`, with
+// its bones in `snapshot`.
+static void CaptureShadowCasters(
+    const std::vector<EntityRef> &casters,
+    std::vector<ShadowCasterSnapshot> *caster_snapshots,
+    RenderSnapshot *snapshot, World *world) {
+  for (auto iter = casters.begin(); iter != casters.end(); ++iter) {
+    if (!iter->IsValid()) continue;
+    const RenderMeshData *rendermesh_data =
+        world->render_mesh_component.GetComponentData(*iter);
+    const TransformData *transform_data =
+        world->transform_component.GetComponentData(*iter);
+    if (rendermesh_data == nullptr || transform_data == nullptr) continue;
+
+    ShadowCasterSnapshot caster;
+    caster.mesh = rendermesh_data->mesh;
+    caster.shader = rendermesh_data->shaders[ShaderIndex_Depth];
+    caster.world_transform =
+        mat4::ToAffineTransform(transform_data->world_transform);
+    // Casters off screen have no draw command, so pose each one here.
+    caster.first_bone = static_cast<int>(snapshot->bones.size());
+    caster.num_bones =
+        AppendPose(*iter, rendermesh_data, world, &snapshot->bones);
+    caster_snapshots->push_back(caster);
+  }
+}
+
+void WorldRenderer::RecordDrawCommands(const corgi::CameraInterface &camera,
+                                       World *world,
+                                       RenderSnapshot *snapshot) {
+  const float cull_distance =
+      world->config->rendering_config()->cull_distance();
+  const mat4 camera_transform = camera.GetTransformMatrix();
+  const vec3 camera_position = camera.position();
+  const vec3 light_position = world->render_mesh_component.light_position();
+  const ViewCone view_cone(camera);
+
+  for (auto iter = world->render_mesh_component.begin();
+       iter != world->render_mesh_component.end(); ++iter) {
+    RenderMeshData *rendermesh_data = &iter->data;
+    if (!rendermesh_data->visible || rendermesh_data->pass_mask == 0 ||
+        rendermesh_data->mesh == nullptr ||
+        rendermesh_data->shaders.size() <= ShaderIndex_Lit ||
+        rendermesh_data->shaders[ShaderIndex_Lit] == nullptr) {
+      continue;
+    }
+    const TransformData *transform_data =
+        world->transform_component.GetComponentData(iter->entity);
+    if (transform_data == nullptr) continue;
+    fplbase::Mesh *mesh = rendermesh_data->mesh;
+
+    const vec3 center =
+        transform_data->world_transform *
+        ((mesh->min_position() + mesh->max_position()) * 0.5f);
+    float scale = 0.0f;
+    for (int i = 0; i < 3; ++i) {
+      scale = std::max(
+          scale, transform_data->world_transform.GetColumn(i).xyz().Length());
+    }
+    const float radius =
+        (mesh->max_position() - mesh->min_position()).Length() * 0.5f * scale;
+    const vec3 to_center = center - camera_position;
+    const float depth = to_center.LengthSquared();
+    if ((rendermesh_data->culling_mask & (1 << corgi::CullingTest_Distance)) &&
+        depth > cull_distance * cull_distance) {
+      continue;
+    }
+    if ((rendermesh_data->culling_mask & (1 << corgi::CullingTest_ViewAngle)) &&
+        !view_cone.ContainsSphere(center, radius)) {
+      continue;
+    }
+
+    // Meshes without a skeleton follow the first bone of their animation.
+    mat4 world_transform = transform_data->world_transform;
+    const AnimationData *anim_data =
+        world->entity_manager.GetComponentData<AnimationData>(iter->entity);
+    if (mesh->num_bones() <= 1 && anim_data != nullptr &&
+        anim_data->motivator.Valid()) {
+      world_transform = world_transform *
+                        mat4::FromAffineTransform(
+                            anim_data->motivator.GlobalTransforms()[0]);
+    }
+    const mat4 world_matrix_inverse = world_transform.Inverse();
+    const mat4 mvp = camera_transform * world_transform;
+
+    DrawCommand command;
+    command.mesh = mesh;
+    command.shader = rendermesh_data->shaders[ShaderIndex_Lit];
+    for (int i = 0; i < 4; ++i) {
+      command.model_view_projection[i] = mvp.GetColumn(i);
+    }
+    command.world_transform = mat4::ToAffineTransform(world_transform);
+    command.camera_position = world_matrix_inverse * camera_position;
+    command.light_position = world_matrix_inverse * light_position;
+    command.color = rendermesh_data->tint;
+    command.first_bone = static_cast<int>(snapshot->bones.size());
+    command.num_bones =
+        AppendPose(iter->entity, rendermesh_data, world, &snapshot->bones);
+    command.depth = depth;
+
+    for (int pass = 0; pass < corgi::RenderPass_Count; ++pass) {
+      if (rendermesh_data->pass_mask & (1 << pass)) {
+        snapshot->draw_commands[pass].push_back(command);
+      }
+    }
+  }
+
+  // Opaque meshes are drawn front to back, so the depth test rejects as much
+  // as possible, and transparent ones back to front, so they blend properly.
+  std::vector<DrawCommand> &opaque =
+      snapshot->draw_commands[corgi::RenderPass_Opaque];
+  std::sort(opaque.begin(), opaque.end(),
+            [](const DrawCommand &a, const DrawCommand &b) {
+              return a.depth < b.depth;
+            });
+  std::vector<DrawCommand> &alpha =
+      snapshot->draw_commands[corgi::RenderPass_Alpha];
+  std::sort(alpha.begin(), alpha.end(),
+            [](const DrawCommand &a, const DrawCommand &b) {
+              return a.depth > b.depth;
+            });
+}
+
+void WorldRenderer::ReplayDrawCommands(int pass, fplbase::Renderer &renderer) {
+  const std::vector<DrawCommand> &commands = snapshot_->draw_commands[pass];
+  for (auto iter = commands.begin(); iter != commands.end(); ++iter) {
+    renderer.set_model_view_projection(mat4(
+        vec4(iter->model_view_projection[0]),
+        vec4(iter->model_view_projection[1]),
+        vec4(iter->model_view_projection[2]),
+        vec4(iter->model_view_projection[3])));
+    renderer.set_model(mat4::FromAffineTransform(iter->world_transform));
+    renderer.set_camera_pos(vec3(iter->camera_position));
+    renderer.set_light_pos(vec3(iter->light_position));
+    renderer.set_color(vec4(iter->color));
+    if (iter->num_bones > 0) {
+      renderer.SetAnimation(&snapshot_->bones[iter->first_bone],
+                            iter->num_bones);
+    }
+    iter->shader->Set(renderer);
+    iter->mesh->Render(renderer);
+  }
+}
+
+void WorldRenderer::ReplayDrawCommands(int pass, const mat4 &view_projection,
+                                       const vec3 &camera_position,
+                                       fplbase::Renderer &renderer) {
+  const std::vector<DrawCommand> &commands = snapshot_->draw_commands[pass];
+  for (auto iter = commands.begin(); iter != commands.end(); ++iter) {
+    const mat4 world_transform =
+        mat4::FromAffineTransform(iter->world_transform);
+    renderer.set_model_view_projection(view_projection * world_transform);
+    renderer.set_model(world_transform);
+    renderer.set_camera_pos(world_transform.Inverse() * camera_position);
+    renderer.set_light_pos(vec3(iter->light_position));
+    renderer.set_color(vec4(iter->color));
+    if (iter->num_bones > 0) {
+      renderer.SetAnimation(&snapshot_->bones[iter->first_bone],
+                            iter->num_bones);
+    }
+    iter->shader->Set(renderer);
+    iter->mesh->Render(renderer);
+  }
+}
+
+void WorldRenderer::CaptureSnapshot(const corgi::CameraInterface &camera,
+                                    World *world) {
+  RenderSnapshot *snapshot = snapshots_.write_snapshot();
+  snapshot->Clear();
+
+  Camera &snapshot_camera = snapshot->camera;
+  snapshot_camera.set_position(camera.position());
+  snapshot_camera.set_facing(camera.facing());
+  snapshot_camera.set_up(camera.up());
+  snapshot_camera.Initialize(
+      camera.viewport_angle(), camera.viewport_resolution(),
+      camera.viewport_near_plane(), camera.viewport_far_plane());
+  snapshot->stereoscopic = world->rendering_mode() == kRenderingStereoscopic;
+
+  if (world->RenderingOptionsDirty()) {
+    ++shader_defines_version_;
+    world->ResetRenderingDirty();
+  }
+  snapshot->shader_defines = EnabledShaderDefines(world);
+  snapshot->shader_defines_version = shader_defines_version_;
+
+  LightComponent *light_component =
+      world->entity_manager.GetComponent<LightComponent>();
+  const LightData *light_data =
+      world->entity_manager.GetComponentData<LightData>(
+          light_component->begin()->entity);
+  snapshot->ambient_material =
+      light_data->ambient_color * light_data->ambient_intensity;
+  snapshot->diffuse_material =
+      light_data->diffuse_color * light_data->diffuse_intensity;
+  snapshot->specular_material =
+      light_data->specular_color * light_data->specular_intensity;
+  snapshot->shininess = light_data->specular_exponent;
+  snapshot->shadow_intensity = light_data->shadow_intensity;
+
+  snapshot->river_offset = world->river_component.river_offset();
+  snapshot->texture_repeats =
+      world->CurrentLevel()->river_config()->texture_repeats();
+  snapshot->skip_rendermesh_rendering = world->skip_rendermesh_rendering;
+
+  // Cardboard's eyes are close enough together that culling for the camera
+  // between them suits both.
+  RecordDrawCommands(camera, world, snapshot);
+
+  if (world->RenderingOptionEnabled(kShadowEffect)) {
+    snapshot->num_shadow_cascades = num_shadow_cascades_;
+    snapshot->static_shadow_version = static_shadow_version_;
+    for (int i = 0; i < num_shadow_cascades_; ++i) {
+      snapshot->light_view_projections[i] =
+          light_cameras_[i].GetTransformMatrix();
+      snapshot->shadow_cascade_splits[i] = shadow_cascade_splits_[i];
+      // The static layer may have to be redrawn from any snapshot, since the
+      // render thread can skip the one that moved the cascades.
+      CaptureShadowCasters(static_shadow_casters_[i],
+                           &snapshot->static_shadow_casters[i], snapshot,
+                           world);
+      CaptureShadowCasters(dynamic_shadow_casters_[i],
+                           &snapshot->dynamic_shadow_casters[i], snapshot,
+                           world);
+    }
+  }
+
+  world->render_3d_text_component.CaptureAllEntities(&snapshot->texts);
+  snapshots_.Publish();
+}
+
 void WorldRenderer::RenderPrep(const corgi::CameraInterface &camera,
                                World *world) {
-  world->render_mesh_component.RenderPrep(camera);
+  world->rail_visibility.Update(world);
+  world->river_component.UpdateRiverMeshes();
+  world->river_component.CullChunks(camera);
+
+  if (world->RenderingOptionEnabled(kShadowEffect)) {
+    PrepareShadowCasters(camera, world);
+  } else {
+    // The static layer isn't kept up to date while shadows are off.
+    shadow_focus_valid_ = false;
+  }
+
+  // Count the bones skinned this frame, to keep an eye on animation cost.
+  num_skinned_bones_ = 0;
+  for (auto iter = world->animation_component.begin();
+       iter != world->animation_component.end(); ++iter) {
+    if (!iter->data.motivator.Valid()) continue;
+    const RenderMeshData *rendermesh_data =
+        world->render_mesh_component.GetComponentData(iter->entity);
+    if (rendermesh_data != nullptr && rendermesh_data->visible) {
+      num_skinned_bones_ += rendermesh_data->num_shader_transforms;
+    }
+  }
+  SystraceCounter("SkinnedBones", num_skinned_bones_);
+
+  CaptureSnapshot(camera, world);
 }
 
 // Draw the shadow map in the world, so we can see it.
@@ -162,7 +684,8 @@ void WorldRenderer::DebugShowShadowMap(const corgi::CameraInterface &camera,
   const mat4 world_matrix_inverse = kDebugTextureWorldTransform.Inverse();
 
   renderer.set_camera_pos(world_matrix_inverse * camera.position());
-  renderer.set_light_pos(world_matrix_inverse * light_camera_.position());
+  renderer.set_light_pos(world_matrix_inverse *
+                         light_cameras_[0].position());
   renderer.set_model_view_projection(mvp);
   renderer.set_color(vec4(1.0f, 1.0f, 1.0f, 1.0f));
 
@@ -188,40 +711,29 @@ void WorldRenderer::SetFogUniforms(fplbase::Shader *shader, World *world) {
                      world->config->rendering_config()->fog_max_saturation());
 }
 
-void WorldRenderer::SetLightingUniforms(fplbase::Shader *shader, World *world) {
-  LightComponent *light_component =
-      world->entity_manager.GetComponent<LightComponent>();
-  const EntityRef &main_light_entity = light_component->begin()->entity;
-  const LightData *light_data =
-      world->entity_manager.GetComponentData<LightData>(main_light_entity);
-
-  if (world->RenderingOptionEnabled(kShadowEffect)) {
-    shader->SetUniform("shadow_intensity", light_data->shadow_intensity);
+void WorldRenderer::SetLightingUniforms(fplbase::Shader *shader) {
+  if (snapshot_->ShaderDefineEnabled(kShadowEffect)) {
+    shader->SetUniform("shadow_intensity", snapshot_->shadow_intensity);
   }
-  shader->SetUniform("ambient_material",
-                     light_data->ambient_color * light_data->ambient_intensity);
-  shader->SetUniform("diffuse_material",
-                     light_data->diffuse_color * light_data->diffuse_intensity);
-  shader->SetUniform("specular_material", light_data->specular_color *
-                                              light_data->specular_intensity);
-  shader->SetUniform("shininess", light_data->specular_exponent);
+  shader->SetUniform("ambient_material", snapshot_->ambient_material);
+  shader->SetUniform("diffuse_material", snapshot_->diffuse_material);
+  shader->SetUniform("specular_material", snapshot_->specular_material);
+  shader->SetUniform("shininess", snapshot_->shininess);
 }
 
-void WorldRenderer::RenderShadowMap(const corgi::CameraInterface &camera,
-                                    fplbase::Renderer &renderer, World *world) {
+void WorldRenderer::RenderShadowMap(fplbase::Renderer &renderer,
+                                    World *world) {
   PushDebugMarker("Render ShadowMap");
 
   PushDebugMarker("Scene Setup");
-  if (world->RenderingOptionsDirty()) {
-    RefreshGlobalShaderDefines(world);
-  }
+  UpdateGlobalShaderDefines(world);
 
   float shadow_map_bias = world->config->rendering_config()->shadow_map_bias();
   depth_shader_->SetUniform("bias", shadow_map_bias);
   depth_skinned_shader_->SetUniform("bias", shadow_map_bias);
   PopDebugMarker(); // Scene Setup
 
-  CreateShadowMap(camera, renderer, world);
+  CreateShadowMap(renderer, world);
 
   PopDebugMarker(); // Render ShadowMap
 }
@@ -231,65 +743,90 @@ void WorldRenderer::RenderWorld(const corgi::CameraInterface &camera,
   PushDebugMarker("Render World");
 
   PushDebugMarker("Scene Setup");
-  if (world->RenderingOptionsDirty()) {
-    RefreshGlobalShaderDefines(world);
-  }
+  UpdateGlobalShaderDefines(world);
 
   mat4 camera_transform = camera.GetTransformMatrix();
   renderer.set_color(mathfu::kOnes4f);
   renderer.SetDepthFunction(fplbase::kDepthFunctionLess);
   renderer.set_model_view_projection(camera_transform);
 
-  float texture_repeats =
-      world->CurrentLevel()->river_config()->texture_repeats();
-  float river_offset = world->river_component.river_offset();
+  if (snapshot_->ShaderDefineEnabled(kShadowEffect)) {
+    // Unused cascades end where the last one in use does, so they're never
+    // picked. w is where the last cascade in use starts.
+    vec4 cascade_splits(0.0f, 0.0f, 0.0f, 0.0f);
+    float split = 0.0f;
+    for (int i = 0; i < kMaxShadowCascades; ++i) {
+      if (i < snapshot_->num_shadow_cascades) {
+        cascade_splits.w = split;
+        split = snapshot_->shadow_cascade_splits[i];
+      }
+      cascade_splits[i] = split;
+    }
 
-  if (world->RenderingOptionEnabled(kShadowEffect)) {
     world->asset_manager->ForEachShaderWithDefine(
         kDefinesText[kShadowEffect], [&](fplbase::Shader *shader) {
           shader->SetUniform("view_projection", camera_transform);
-          shader->SetUniform("light_view_projection",
-                             light_camera_.GetTransformMatrix());
+          for (int i = 0; i < snapshot_->num_shadow_cascades; ++i) {
+            shader->SetUniform(kLightViewProjectionUniforms[i],
+                               snapshot_->light_view_projections[i]);
+          }
+          shader->SetUniform("cascade_splits", cascade_splits);
         });
   }
 
   world->asset_manager->ForEachShaderWithDefine(
       "WATER", [&](fplbase::Shader *shader) {
-        shader->SetUniform("river_offset", river_offset);
-        shader->SetUniform("texture_repeats", texture_repeats);
+        shader->SetUniform("river_offset", snapshot_->river_offset);
+        shader->SetUniform("texture_repeats", snapshot_->texture_repeats);
       });
 
   world->asset_manager->ForEachShaderWithDefine(
       kDefinesText[kPhongShading],
-      [&](fplbase::Shader *shader) { SetLightingUniforms(shader, world); });
+      [&](fplbase::Shader *shader) { SetLightingUniforms(shader); });
 
   world->asset_manager->ForEachShaderWithDefine(
       "FOG_EFFECT",
       [&](fplbase::Shader *shader) { SetFogUniforms(shader, world); });
 
   shadow_map_.BindAsTexture(kShadowMapTextureID);
+  static_shadow_map_.BindAsTexture(kStaticShadowMapTextureID);
   PopDebugMarker(); // Scene Setup
 
-  if (!world->skip_rendermesh_rendering) {
+  if (!snapshot_->skip_rendermesh_rendering) {
     for (int pass = 0; pass < corgi::RenderPass_Count; pass++) {
       PushDebugMarker("RenderPass");
-      world->render_mesh_component.RenderPass(pass, camera, renderer);
+      if (camera.IsStereo()) {
+        for (int eye = 0; eye < 2; ++eye) {
+          const mathfu::vec4i &viewport = camera.viewport(eye);
+          glViewport(viewport.x, viewport.y, viewport.z, viewport.w);
+          ReplayDrawCommands(pass, camera.GetTransformMatrix(eye),
+                             camera.position(eye), renderer);
+        }
+      } else {
+        ReplayDrawCommands(pass, renderer);
+      }
       PopDebugMarker();
     }
   }
 
-  if (world->draw_debug_physics) {
-    PushDebugMarker("Debug Draw World");
-    world->physics_component.DebugDrawWorld(&renderer, camera_transform);
-    PopDebugMarker();
-  }
-
   PushDebugMarker("Text");
-  world->render_3d_text_component.RenderAllEntities(camera);
+  for (auto iter = snapshot_->texts.begin(); iter != snapshot_->texts.end();
+       ++iter) {
+    world->render_3d_text_component.RenderText(*iter, camera);
+  }
   PopDebugMarker();
 
   PopDebugMarker(); // Render World
 }
 
+void WorldRenderer::RenderDebugPhysics(fplbase::Renderer &renderer,
+                                       World *world) {
+  if (!world->draw_debug_physics) return;
+  PushDebugMarker("Debug Draw World");
+  world->physics_component.DebugDrawWorld(
+      &renderer, snapshot_->camera.GetTransformMatrix());
+  PopDebugMarker();
+}
+
 }  // zooshi
 }  // fpl
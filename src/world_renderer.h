@@ -15,6 +15,8 @@
 #ifndef ZOOSHI_WORLD_RENDERER_H_
 #define ZOOSHI_WORLD_RENDERER_H_
 
+#include "dynamic_resolution.h"
+#include "render_snapshot.h"
 #include "world.h"
 
 namespace fpl {
@@ -32,19 +34,46 @@ class WorldRenderer {
   void RefreshGlobalShaderDefines(World* world);
 
   // Call this before you call RenderWorld - it takes care of clearing
-  // the frame, setting up the shadowmap, etc.
+  // the frame, setting up the shadowmap, etc. It ends by taking a snapshot of
+  // what the render thread needs from the world.
   void RenderPrep(const corgi::CameraInterface& camera,
                   World* world);
 
-  // Render the shadowmap from the current camera.
-  void RenderShadowMap(const corgi::CameraInterface& camera,
-                       fplbase::Renderer& renderer, World* world);
+  // Pick up the newest snapshot taken by RenderPrep. Call this once a frame,
+  // before RenderShadowMap and RenderWorld, so they draw the same snapshot.
+  void AcquireSnapshot() { snapshot_ = snapshots_.Acquire(); }
 
-  // Render the world, viewed from the current camera.
+  // The snapshot picked up by the last AcquireSnapshot. Only the render
+  // thread may call this.
+  const RenderSnapshot& snapshot() const { return *snapshot_; }
+
+  // Delete `mesh` on the render thread once no snapshot it could still draw
+  // refers to it. Call this on the update thread, before RenderPrep takes
+  // the next snapshot, instead of deleting a mesh the world has let go of.
+  void RetireMesh(fplbase::Mesh* mesh) { snapshots_.RetireMesh(mesh); }
+
+  // Render the shadowmap for the current snapshot.
+  void RenderShadowMap(fplbase::Renderer& renderer, World* world);
+
+  // Render the current snapshot, viewed from `camera`, which is the
+  // snapshot's camera or, in Cardboard, one made from it for each eye. Only
+  // the snapshot and the render thread's own state are read, so the update
+  // thread may be running.
   void RenderWorld(const corgi::CameraInterface& camera,
                    fplbase::Renderer& renderer,
                    World* world);
 
+  // Draw the physics world's debug lines over the frame, from the current
+  // snapshot's camera, if World::draw_debug_physics is set. This reads the
+  // live physics world, so the update thread must be paused.
+  void RenderDebugPhysics(fplbase::Renderer& renderer, World* world);
+
+  // Force the static shadow layer to be redrawn on the next frame. Call this
+  // when static casters may have been added, removed or moved. Like
+  // RenderPrep, which is the only reader of the flag, it must be called on
+  // the update thread.
+  void InvalidateStaticShadows() { shadow_focus_valid_ = false; }
+
   // Render the shadowmap into the world as a billboard, for debugging.
   void DebugShowShadowMap(const corgi::CameraInterface& camera,
                           fplbase::Renderer& renderer);
@@ -52,24 +81,110 @@ class WorldRenderer {
   // Sets the position of the light source in the world.  (Where the light is
   // located when generating shdaow maps, etc.)
   void SetLightPosition(const mathfu::vec3& light_pos) {
-    light_camera_.set_position(light_pos);
+    for (int i = 0; i < kMaxShadowCascades; ++i) {
+      light_cameras_[i].set_position(light_pos);
+    }
   }
 
+  // Number of bones skinned for visible meshes in the last RenderPrep.
+  int num_skinned_bones() const { return num_skinned_bones_; }
+
+  // Picks the resolution the world is rendered at, outside of Cardboard.
+  DynamicResolution& dynamic_resolution() { return dynamic_resolution_; }
+
  private:
   fplbase::Shader* depth_shader_;
   fplbase::Shader* depth_skinned_shader_;
   fplbase::Shader* textured_shader_;
-  Camera light_camera_;
+  // One light camera per cascade, each framing a slice of the camera's view.
+  Camera light_cameras_[kMaxShadowCascades];
+  // The shadow map is split into two layers. Casters that never move are
+  // drawn into the static layer, which is only redrawn once the cascades
+  // have moved far enough. Everything else is drawn into `shadow_map_` every
+  // frame, and the shaders use the nearer of the two.
   fplbase::RenderTarget shadow_map_;
+  fplbase::RenderTarget static_shadow_map_;
+  std::vector<corgi::EntityRef> static_shadow_casters_[kMaxShadowCascades];
+  std::vector<corgi::EntityRef> dynamic_shadow_casters_[kMaxShadowCascades];
+  int num_shadow_cascades_;
+  // Distance from the camera at which each cascade ends.
+  float shadow_cascade_splits_[kMaxShadowCascades];
+  // Bounding sphere of the slice of the view each cascade covers. These stay
+  // put until one of the slices moves further than
+  // static_shadow_refresh_distance.
+  mathfu::vec3 shadow_cascade_centers_[kMaxShadowCascades];
+  float shadow_cascade_radii_[kMaxShadowCascades];
+  // Only touched on the update thread. Static casters are collected only in
+  // the RenderPrep that finds it cleared or the cascades moved.
+  bool shadow_focus_valid_;
+  // Bumped by RenderPrep whenever the static layer has to be redrawn, and
+  // compared by the render thread with the version it last drew.
+  unsigned int static_shadow_version_;
+  unsigned int drawn_static_shadow_version_;
+  // Bumped by RenderPrep whenever the rendering options change, and compared
+  // by the render thread with the version its shaders were built with.
+  unsigned int shader_defines_version_;
+  unsigned int built_shader_defines_version_;
+  int num_skinned_bones_;
+  DynamicResolution dynamic_resolution_;
+  // Snapshots pass from RenderPrep, on the update thread, to the render
+  // thread, which draws everything in the world from `snapshot_`.
+  RenderSnapshotBuffer snapshots_;
+  const RenderSnapshot* snapshot_;
+
+  // Fit the cascades to the camera, and collect the casters to draw into
+  // each cascade of each shadow map layer.
+  void PrepareShadowCasters(const corgi::CameraInterface& camera,
+                            World* world);
+
+  // Whether a caster with the given bounding sphere can shadow anything in
+  // `cascade`.
+  bool ShadowCascadeContains(int cascade, const mathfu::vec3& center,
+                             float radius) const;
+
+  // Fill in the next snapshot from the world, and hand it to the render
+  // thread.
+  void CaptureSnapshot(const corgi::CameraInterface& camera, World* world);
+
+  // Cull and sort the meshes visible from `camera` into each render pass of
+  // `snapshot`, with their uniforms and poses.
+  void RecordDrawCommands(const corgi::CameraInterface& camera, World* world,
+                          RenderSnapshot* snapshot);
+
+  // Draw the commands recorded for `pass` in the current snapshot, from the
+  // snapshot's own camera.
+  void ReplayDrawCommands(int pass, fplbase::Renderer& renderer);
+
+  // Draw the commands recorded for `pass` in the current snapshot from
+  // `view_projection` and `camera_position`, such as one eye's in Cardboard.
+  void ReplayDrawCommands(int pass, const mathfu::mat4& view_projection,
+                          const mathfu::vec3& camera_position,
+                          fplbase::Renderer& renderer);
+
+  // Build the shaders with the defines the current snapshot enables, unless
+  // they already have been.
+  void UpdateGlobalShaderDefines(World* world);
 
-  // Create the shadowmap for the current worldstate.  Needs to be called
+  // Build the shaders with the defines set in `shader_defines`, one bit for
+  // each ShaderDefines option.
+  void SetGlobalShaderDefines(unsigned int shader_defines, World* world);
+
+  // Create the shadowmap for the current snapshot.  Needs to be called
   // before RenderWorld.
-  void CreateShadowMap(const corgi::CameraInterface& camera,
-                       fplbase::Renderer& renderer, World* world);
+  void CreateShadowMap(fplbase::Renderer& renderer, World* world);
+
+  // Draw the depth of each caster in `casters` into every cascade's quadrant
+  // of the current render target.
+  void RenderShadowCascades(const std::vector<ShadowCasterSnapshot>* casters,
+                            fplbase::Renderer& renderer, World* world);
+
+  // Draw the depth of each of `casters` from the light camera of `cascade`.
+  void RenderShadowCasters(const std::vector<ShadowCasterSnapshot>& casters,
+                           int cascade, fplbase::Renderer& renderer);
 
   void SetFogUniforms(fplbase::Shader* shader, World* world);
 
-  void SetLightingUniforms(fplbase::Shader* shader, World* world);
+  void SetLightingUniforms(fplbase::Shader* shader);
 };
 
 }  // zooshi